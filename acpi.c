@@ -2,6 +2,8 @@
 #include "acpi.h"
 #include "print.h" // Assuming you have print/print_hex
 #include "ports.h" // Assuming inb/outb/outw defined here
+#include "console.h"
+#include "serial.h"
 
 // --- GLOBALS ---
 uint32 PM1a_CNT = 0;
@@ -10,6 +12,9 @@ uint16 SLP_TYPa = 0;
 uint16 SLP_TYPb = 0;
 uint16 SLP_EN   = 1 << 13; // ACPI standard bit to trigger the sleep
 
+uint32 acpi_cpu_count = 0;
+uint8 acpi_cpu_apic_ids[ACPI_MAX_CPUS];
+
 // Helper: Check checksum
 int check_sdt_checksum(struct ACPISDTHeader *tableHeader) {
     unsigned char sum = 0;
@@ -90,6 +95,20 @@ void parse_dsdt(char* ptr, int len) {
     print("ERR: _S5_ not found in DSDT.\n");
 }
 
+// 3. Collect the local APIC IDs of the usable CPUs from the MADT
+void parse_madt(struct MADT* madt) {
+    uint8* entry = madt->Entries;
+    uint8* end = (uint8*)madt + madt->h.Length;
+
+    while (entry + 2 <= end && entry[1] >= 2) {
+        struct MADTLocalApic* lapic = (struct MADTLocalApic*)entry;
+        // Disabled but online-capable CPUs are hot-plug slots, not CPUs
+        if (lapic->Type == MADT_LOCAL_APIC && (lapic->Flags & 1) && acpi_cpu_count < ACPI_MAX_CPUS)
+            acpi_cpu_apic_ids[acpi_cpu_count++] = lapic->ApicId;
+        entry += entry[1];
+    }
+}
+
 void init_acpi() {
     print("Searching for ACPI...\n");
     struct RSDPDescriptor* rsdp = get_rsdp();
@@ -105,10 +124,18 @@ void init_acpi() {
     }
     
     int entries = (rsdt->h.Length - sizeof(struct ACPISDTHeader)) / 4;
+    int fadt_found = 0;
     
     for (int i = 0; i < entries; i++) {
         struct ACPISDTHeader* h = (struct ACPISDTHeader*)rsdt->PointerToOtherSDT[i];
         
+        // Check for MADT signature
+        if (h->Signature[0] == 'A' && h->Signature[1] == 'P' &&
+            h->Signature[2] == 'I' && h->Signature[3] == 'C') {
+            parse_madt((struct MADT*)h);
+            continue;
+        }
+
         // Check for FADT signature
         if (h->Signature[0] == 'F' && h->Signature[1] == 'A' && 
             h->Signature[2] == 'C' && h->Signature[3] == 'P') {
@@ -129,11 +156,11 @@ void init_acpi() {
             // 3. Parse DSDT to get the magic numbers
             struct ACPISDTHeader* dsdt = (struct ACPISDTHeader*)fadt->Dsdt;
             parse_dsdt((char*)dsdt + sizeof(struct ACPISDTHeader), dsdt->Length);
-            
-            return;
+            fadt_found = 1;
         }
     }
-    print("FADT not found.\n");
+    if (!fadt_found)
+        print("FADT not found.\n");
 }
 
 void acpi_shutdown() {
@@ -143,6 +170,8 @@ void acpi_shutdown() {
     }
     
     print("ACPI Shutdown...\n");
+    console_flush();
+    serial_flush();
     
     // Send the shutdown command
     outw(PM1a_CNT, SLP_TYPa | SLP_EN);
@@ -153,5 +182,6 @@ void acpi_shutdown() {
     
     // If we are here, it failed.
     print("Shutdown failed.");
+    console_flush();
     while(1);
 }
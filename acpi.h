@@ -50,6 +50,29 @@ struct FADT {
     // ... (There are more fields, but these are the ones we need for S5)
 } __attribute__ ((packed));
 
+// MADT (signature "APIC"): the interrupt controllers, one record per CPU's local APIC
+struct MADT {
+    struct ACPISDTHeader h;
+    uint32 LocalApicAddress;
+    uint32 Flags;
+    uint8  Entries[];        // Variable-length records, each starting with type and length
+} __attribute__ ((packed));
+
+#define MADT_LOCAL_APIC 0
+
+struct MADTLocalApic {
+    uint8  Type;             // MADT_LOCAL_APIC
+    uint8  Length;
+    uint8  ProcessorId;
+    uint8  ApicId;
+    uint32 Flags;            // Bit 0: enabled, bit 1: online capable
+} __attribute__ ((packed));
+
+// CPUs found in the MADT (see smp.h)
+#define ACPI_MAX_CPUS 16
+extern uint32 acpi_cpu_count;
+extern uint8 acpi_cpu_apic_ids[ACPI_MAX_CPUS];
+
 void init_acpi();
 void acpi_shutdown();
 
@@ -0,0 +1,43 @@
+// app/bench_mmio.c
+// Cycles per trapped access on the kernel's bench device page
+
+#include "../syscall/syscalls.h"
+
+#define BENCH_DEVICE 0x1F1000 // Must match BENCH_DEVICE_ADDR in bench.h
+#define ITERATION_SHIFT 10
+#define ITERATIONS (1 << ITERATION_SHIFT)
+
+__attribute__((section(".text.entry")))
+void start_app() {
+    volatile uint32* reg = (uint32*)BENCH_DEVICE;
+    uint32 sink;
+    uint64 start;
+
+    sink = *reg; // Warm up
+
+    // Plain load: MOV r32, [mem]
+    start = rdtsc();
+    for (int i = 0; i < ITERATIONS; i++)
+        sink = *reg;
+    bench_result("hooked_read", (uint32)((rdtsc() - start) >> ITERATION_SHIFT));
+
+    // Plain store: MOV [mem], r32
+    start = rdtsc();
+    for (int i = 0; i < ITERATIONS; i++)
+        *reg = i;
+    bench_result("hooked_write", (uint32)((rdtsc() - start) >> ITERATION_SHIFT));
+
+    // Single read-modify-write instruction
+    start = rdtsc();
+    for (int i = 0; i < ITERATIONS; i++)
+        asm volatile("orl $1, (%0)" : : "r"(reg) : "memory");
+    bench_result("hooked_rmw", (uint32)((rdtsc() - start) >> ITERATION_SHIFT));
+
+    // ADC is not emulated: measures the #PF + #DB single-step fallback
+    start = rdtsc();
+    for (int i = 0; i < ITERATIONS; i++)
+        asm volatile("adcl $0, (%0)" : : "r"(reg) : "memory", "cc");
+    bench_result("hooked_rmw_single_step", (uint32)((rdtsc() - start) >> ITERATION_SHIFT));
+
+    (void)sink;
+}
@@ -0,0 +1,22 @@
+// app/bench_sys.c
+// Syscall round trip through the path syscalls.h picks: SYSENTER/SYSEXIT
+// when CPUID reports SEP, int 0x80 otherwise. The result name says which.
+
+#include "../syscall/syscalls.h"
+
+#define ITERATION_SHIFT 10
+#define ITERATIONS (1 << ITERATION_SHIFT)
+
+__attribute__((section(".text.entry")))
+void start_app() {
+    uint64 start;
+
+    get_hook_stats(0, 0, 0); // Warm up
+
+    // Cheapest syscall there is: stats lookup of an address that is not hooked
+    start = rdtsc();
+    for (int i = 0; i < ITERATIONS; i++)
+        get_hook_stats(0, 0, 0);
+    bench_result(syscall_sysenter ? "syscall_round_trip_sysenter" : "syscall_round_trip_int80",
+                 (uint32)((rdtsc() - start) >> ITERATION_SHIFT));
+}
@@ -0,0 +1,55 @@
+// app/bench_timer.c
+// Interval and jitter of the timer callback (nominal 50us), and how long a
+// spin on the countdown timer device takes in real time
+
+#include "../syscall/syscalls.h"
+
+#define SAMPLE_SHIFT 8
+#define SAMPLES (1 << SAMPLE_SHIFT)
+
+#define VTIMER_DEVICE 0x1F4000 // Must match VTIMER_DEVICE_ADDR in vtimer.h
+#define VTIMER_WAIT   20000    // Ticks: one second of virtual time
+
+// The kernel does not clear our .bss, so everything is set in start_app
+volatile int sample_count;
+uint64 samples[SAMPLES + 1];
+
+void on_tick() {
+    if (sample_count <= SAMPLES) {
+        samples[sample_count] = rdtsc();
+        sample_count++;
+    }
+}
+
+__attribute__((section(".text.entry")))
+void start_app() {
+    sample_count = SAMPLES + 1; // Keep the callback idle until we are ready
+    register_timer_function(on_tick);
+    sample_count = 0;
+
+    while (sample_count <= SAMPLES);
+
+    uint64 total = samples[SAMPLES] - samples[0];
+    uint32 min = 0xFFFFFFFF;
+    uint32 max = 0;
+    for (int i = 0; i < SAMPLES; i++) {
+        uint32 interval = (uint32)(samples[i + 1] - samples[i]);
+        if (interval < min) min = interval;
+        if (interval > max) max = interval;
+    }
+
+    bench_result("timer_interval_avg", (uint32)(total >> SAMPLE_SHIFT));
+    bench_result("timer_interval_min", min);
+    bench_result("timer_interval_max", max);
+    bench_result("timer_jitter", max - min);
+
+    // One-shot countdown, then spin on STATUS.expired. Polling detection
+    // jumps virtual time to the expiry, so this is nowhere near a second.
+    volatile uint32* vtimer = (uint32*)VTIMER_DEVICE;
+    uint64 start = rdtsc();
+    vtimer[1] = VTIMER_WAIT; // LOAD
+    vtimer[0] = 1;           // CTRL: enable
+    while (!(vtimer[2] & 1));
+    vtimer[2] = 1;           // Clear STATUS.expired
+    bench_result("vtimer_wait_1s", (uint32)(rdtsc() - start));
+}
@@ -1,6 +1,20 @@
 // ata.c
 #include "ports.h"
 #include "ata.h"
+#include "pci.h"
+#include "print.h"
+
+uint16 bm_base = 0;     // Bus-master I/O base, 0 = PIO only
+int dma_probed = 0;
+
+// 255 sectors split at 64KB boundaries never need more than 3 regions.
+// Aligned so the table itself never crosses a 64KB boundary either.
+struct PRDEntry prd_table[PRD_MAX_ENTRIES] __attribute__((aligned(64)));
+
+// Pending requests; queue[queue_head] is the one the drive is working on
+struct ATARequest* ata_queue[ATA_QUEUE_SIZE];
+uint32 queue_head = 0;
+uint32 queue_tail = 0;
 
 void ata_wait_bsy() {
     while(inb(ATA_PRIMARY_COMMAND) & ATA_STATUS_BSY);
@@ -18,43 +32,267 @@ void ata_io_wait() {
     inb(ATA_PRIMARY_COMMAND);
 }
 
-// Internal function to read a SINGLE batch (max 255 sectors)
-void ata_read_batch(uint32 lba, uint8 count, uint16* buffer) {
-    ata_wait_bsy();
+void ata_init_dma() {
+    dma_probed = 1;
+
+    // Mass storage (0x01) / IDE (0x01); prog-if bit 7 = bus-master capable
+    uint32 dev = pci_find_class(0x01, 0x01);
+    if (dev == PCI_NONE || !((pci_read32(dev, PCI_CLASS_REVISION) >> 8) & 0x80)) {
+        print("ATA: No bus-master IDE, using PIO\n");
+        return;
+    }
+
+    // BAR4 is an I/O BAR (bit 0 set); the primary channel uses its first 8 ports
+    uint32 bar4 = pci_read32(dev, PCI_BAR4);
+    if (!(bar4 & 1) || (bar4 & 0xFFFC) == 0) {
+        print("ATA: Bus-master BAR not assigned, using PIO\n");
+        return;
+    }
+
+    uint32 command = pci_read32(dev, PCI_COMMAND);
+    pci_write32(dev, PCI_COMMAND, command | PCI_COMMAND_IO | PCI_COMMAND_BUS_MASTER);
+
+    bm_base = bar4 & 0xFFFC;
+}
+
+// Fills the PRD table for 'bytes' at physical address 'buffer'.
+// The buffer is identity mapped (it is read before paging, and the first 4MB stay identity mapped).
+void ata_build_prd(uint32 buffer, uint32 bytes) {
+    int n = 0;
+    while (bytes > 0) {
+        // Up to the next 64KB boundary
+        uint32 len = 0x10000 - (buffer & 0xFFFF);
+        if (len > bytes)
+            len = bytes;
+
+        prd_table[n].address = buffer;
+        prd_table[n].byte_count = (uint16)len; // 0x10000 truncates to 0 = 64KB
+        prd_table[n].flags = 0;
+
+        buffer += len;
+        bytes -= len;
+        n++;
+    }
+    prd_table[n - 1].flags = PRD_EOT;
+}
 
+// Sends the task file for one command (at most 255 sectors)
+void ata_issue(uint32 lba, uint8 count, uint8 command) {
+    ata_wait_bsy();
     outb(ATA_PRIMARY_DRIVE_HEAD, 0xE0 | ((lba >> 24) & 0x0F));
     ata_io_wait();
     outb(ATA_PRIMARY_SEC_COUNT, count);
     outb(ATA_PRIMARY_LBA_LO, (uint8)lba);
     outb(ATA_PRIMARY_LBA_MID, (uint8)(lba >> 8));
     outb(ATA_PRIMARY_LBA_HI, (uint8)(lba >> 16));
-    outb(ATA_PRIMARY_COMMAND, ATA_CMD_READ_PIO);
+    outb(ATA_PRIMARY_COMMAND, command);
+}
+
+// Starts the next batch of 'req'. Returns without waiting for the data.
+void ata_start_batch(struct ATARequest* req) {
+    uint8* buffer = (uint8*)req->buffer + req->done * 512;
+    uint32 left = req->count - req->done;
+
+    // We can read max 255 sectors per command safely
+    req->batch = (left > 255) ? 255 : left;
+    req->batch_done = 0;
 
-    // If count is 0, ATA specs say it reads 256 sectors.
-    // However, to keep math simple, we will stick to 1-255 in the loop below.
-    int sectors_to_read = (count == 0) ? 256 : count;
+    // DMA needs a word-aligned buffer
+    req->dma = bm_base && !((uint32)buffer & 1);
 
-    for (int i = 0; i < sectors_to_read; i++) {
+    if (req->dma) {
+        // 1. Program the bus-master engine while it is stopped
+        uint8 direction = req->write ? 0 : BM_CMD_READ;
+        ata_build_prd((uint32)buffer, req->batch * 512);
+        outb(bm_base + BM_COMMAND, 0);
+        outl(bm_base + BM_PRD_TABLE, (uint32)prd_table);
+        outb(bm_base + BM_COMMAND, direction);
+        // IRQ and ERR are write-1-to-clear
+        outb(bm_base + BM_STATUS, inb(bm_base + BM_STATUS) | BM_STATUS_IRQ | BM_STATUS_ERR);
+
+        // 2. Issue the command and start the engine
+        ata_issue(req->lba + req->done, (uint8)req->batch, req->write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA);
+        outb(bm_base + BM_COMMAND, direction | BM_CMD_START);
+    } else if (req->write) {
+        // The first sector is pushed right away, the IRQ then asks for each next one
+        ata_issue(req->lba + req->done, (uint8)req->batch, ATA_CMD_WRITE_PIO);
         ata_wait_bsy();
         ata_wait_drq();
-        insw(ATA_PRIMARY_DATA, buffer, 256); // 256 words = 512 bytes
-        buffer += 256;
+        outsw(ATA_PRIMARY_DATA, buffer, 256);
+        ata_io_wait(); // Let BSY rise before anyone polls the status
+        req->batch_done = 1;
+    } else {
+        ata_issue(req->lba + req->done, (uint8)req->batch, ATA_CMD_READ_PIO);
     }
 }
 
-// Public function that handles ANY size
-void ata_read_sectors(uint32 lba, uint32 count, void* buffer) {
-    uint16* ptr = (uint16*)buffer;
+// Starts whatever is at the head of the queue, if anything
+void ata_start_next() {
+    if (queue_head == queue_tail)
+        return;
+
+    struct ATARequest* req = ata_queue[queue_head % ATA_QUEUE_SIZE];
+    req->status = ATA_REQ_ACTIVE;
+    ata_start_batch(req);
+}
 
-    while (count > 0) {
-        // We can read max 255 sectors per command safely
-        uint32 chunk = (count > 255) ? 255 : count;
+void ata_finish(struct ATARequest* req, uint8 status) {
+    queue_head++;
+    req->status = status;
 
-        ata_read_batch(lba, (uint8)chunk, ptr);
+    // Keep the drive busy first; the callback may also submit (it is just queued then)
+    ata_start_next();
+    if (req->callback)
+        req->callback(req);
+}
 
-        // Update pointers and counters
-        count -= chunk;
-        lba   += chunk;
-        ptr   += (chunk * 256); // Move pointer by (chunk * 512 bytes / 2 bytes per word)
+// Advances the active request if the drive has made progress.
+// Shared by the IRQ handler and ata_wait; interrupts must be disabled.
+void ata_service() {
+    if (queue_head == queue_tail) {
+        // Nothing in flight: just ack whatever raised the line
+        inb(ATA_PRIMARY_COMMAND);
+        return;
     }
+
+    struct ATARequest* req = ata_queue[queue_head % ATA_QUEUE_SIZE];
+    uint8* buffer = (uint8*)req->buffer + (req->done + req->batch_done) * 512;
+
+    if (req->dma) {
+        uint8 bm_status = inb(bm_base + BM_STATUS);
+        if (!(bm_status & (BM_STATUS_IRQ | BM_STATUS_ERR)))
+            return; // Still transferring
+
+        // Stop the engine and acknowledge the drive (reading status clears INTRQ)
+        outb(bm_base + BM_COMMAND, 0);
+        outb(bm_base + BM_STATUS, BM_STATUS_IRQ | BM_STATUS_ERR);
+        ata_wait_bsy();
+        uint8 status = inb(ATA_PRIMARY_COMMAND);
+
+        if ((bm_status & BM_STATUS_ERR) || (status & ATA_STATUS_ERR)) {
+            // Redo this batch over PIO, and everything after it
+            print("ERR: ATA DMA failed, falling back to PIO\n");
+            bm_base = 0;
+            ata_start_batch(req);
+            return;
+        }
+        req->batch_done = req->batch;
+    } else {
+        if (inb(ATA_PRIMARY_ALT_STATUS) & ATA_STATUS_BSY)
+            return;
+
+        uint8 status = inb(ATA_PRIMARY_COMMAND);
+        if (status & ATA_STATUS_ERR) {
+            ata_finish(req, ATA_REQ_ERROR);
+            return;
+        }
+
+        if (req->write) {
+            // Each IRQ acknowledges one sector; the last one ends the command
+            if (req->batch_done < req->batch) {
+                if (!(status & ATA_STATUS_DRQ))
+                    return;
+                outsw(ATA_PRIMARY_DATA, buffer, 256);
+                ata_io_wait();
+                req->batch_done++;
+                return;
+            }
+        } else {
+            if (!(status & ATA_STATUS_DRQ))
+                return;
+            insw(ATA_PRIMARY_DATA, buffer, 256); // 256 words = 512 bytes
+            ata_io_wait();
+            req->batch_done++;
+            if (req->batch_done < req->batch)
+                return;
+        }
+    }
+
+    // Batch complete
+    req->done += req->batch;
+    if (req->done == req->count)
+        ata_finish(req, ATA_REQ_DONE);
+    else
+        ata_start_batch(req);
+}
+
+void ata_init_irq() {
+    outb(0x21, inb(0x21) & ~(1 << 2)); // Cascade (IRQ2) on the master
+    outb(0xA1, inb(0xA1) & ~(1 << 6)); // IRQ14 on the slave
+}
+
+int ata_submit(struct ATARequest* req) {
+    if (req->count == 0)
+        return ATA_ERR_INVALID;
+
+    if (!dma_probed)
+        ata_init_dma();
+
+    uint32 flags = irq_save();
+    if (queue_tail - queue_head == ATA_QUEUE_SIZE) {
+        irq_restore(flags);
+        return ATA_ERR_FULL;
+    }
+
+    req->status = ATA_REQ_QUEUED;
+    req->done = 0;
+    req->batch = 0;
+    req->batch_done = 0;
+    ata_queue[queue_tail % ATA_QUEUE_SIZE] = req;
+    queue_tail++;
+
+    // Idle drive: this request goes out immediately
+    if (queue_tail - queue_head == 1)
+        ata_start_next();
+
+    irq_restore(flags);
+    return ATA_OK;
+}
+
+int ata_request_finished(struct ATARequest* req) {
+    return req->status == ATA_REQ_DONE || req->status == ATA_REQ_ERROR;
+}
+
+int ata_wait(struct ATARequest* req) {
+    while (!ata_request_finished(req)) {
+        uint32 flags = irq_save();
+        ata_service();
+        irq_restore(flags);
+    }
+    return req->status;
+}
+
+void ata_irq_handler() {
+    ata_service();
+}
+
+void ata_transfer_sync(uint32 lba, uint32 count, void* buffer, uint8 write) {
+    struct ATARequest req;
+    req.lba = lba;
+    req.count = count;
+    req.buffer = buffer;
+    req.write = write;
+    req.callback = 0;
+
+    int result;
+    while ((result = ata_submit(&req)) == ATA_ERR_FULL) {
+        // Let the requests ahead of us drain
+        uint32 flags = irq_save();
+        ata_service();
+        irq_restore(flags);
+    }
+    if (result != ATA_OK)
+        return;
+
+    if (ata_wait(&req) == ATA_REQ_ERROR)
+        print("ERR: ATA transfer failed\n");
+}
+
+// Public function that handles ANY size
+void ata_read_sectors(uint32 lba, uint32 count, void* buffer) {
+    ata_transfer_sync(lba, count, buffer, 0);
+}
+
+void ata_write_sectors(uint32 lba, uint32 count, void* buffer) {
+    ata_transfer_sync(lba, count, buffer, 1);
 }
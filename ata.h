@@ -1,6 +1,8 @@
 #ifndef ATA_H
 #define ATA_H
 
+#include "kernel.h"
+
 #define ATA_PRIMARY_DATA         0x1F0
 #define ATA_PRIMARY_ERR          0x1F1
 #define ATA_PRIMARY_SEC_COUNT    0x1F2
@@ -9,14 +11,97 @@
 #define ATA_PRIMARY_LBA_HI       0x1F5
 #define ATA_PRIMARY_DRIVE_HEAD   0x1F6
 #define ATA_PRIMARY_COMMAND      0x1F7
+#define ATA_PRIMARY_ALT_STATUS   0x3F6 // Same as COMMAND status, but reading it does not ack the IRQ
 #define ATA_CMD_READ_PIO         0x20
+#define ATA_CMD_WRITE_PIO        0x30
+#define ATA_CMD_READ_DMA         0xC8
+#define ATA_CMD_WRITE_DMA        0xCA
 #define ATA_STATUS_BSY           0x80
 #define ATA_STATUS_DRQ           0x08
+#define ATA_STATUS_ERR           0x01
+
+// Bus-master IDE registers, relative to BAR4 (primary channel)
+#define BM_COMMAND               0x00
+#define BM_STATUS                0x02
+#define BM_PRD_TABLE             0x04
+#define BM_CMD_START             0x01
+#define BM_CMD_READ              0x08 // Direction: device -> memory (clear for writes)
+#define BM_STATUS_ACTIVE         0x01
+#define BM_STATUS_ERR            0x02
+#define BM_STATUS_IRQ            0x04
+
+// Physical Region Descriptor: one contiguous chunk of the DMA buffer.
+// A region may not cross a 64KB boundary; byte_count 0 means 64KB.
+#define PRD_EOT                  0x8000
+#define PRD_MAX_ENTRIES          8
+
+struct PRDEntry {
+    uint32 address;
+    uint16 byte_count;
+    uint16 flags;
+} __attribute__((packed));
 
 void ata_wait_bsy();
 
 void ata_wait_drq();
 
-// Read 'count' sectors starting at 'lba' into 'buffer'
+// --- ASYNC REQUEST QUEUE ---
+// Requests are owned by the caller and must stay alive until they complete.
+// The drive works on one request at a time, in submission order; each
+// 255-sector batch (DMA) or sector (PIO) completes in the IRQ14 handler.
+#define ATA_QUEUE_SIZE 32
+
+#define ATA_REQ_QUEUED 0
+#define ATA_REQ_ACTIVE 1
+#define ATA_REQ_DONE   2
+#define ATA_REQ_ERROR  3
+
+// Status codes
+#define ATA_OK           0
+#define ATA_ERR_FULL    -1
+#define ATA_ERR_INVALID -2
+
+struct ATARequest;
+// Called from the IRQ14 handler (or from ata_wait), with interrupts disabled
+typedef void (*ATACallback)(struct ATARequest* req);
+
+struct ATARequest {
+    uint32 lba;
+    uint32 count;          // Sectors
+    void* buffer;
+    uint8 write;           // 0 = read into buffer, 1 = write from buffer
+    volatile uint8 status; // ATA_REQ_*
+    ATACallback callback;  // Optional
+    void* context;         // For the callback
+
+    // Driver progress
+    uint32 done;           // Sectors finished in earlier batches
+    uint32 batch;          // Sectors in the command in flight
+    uint32 batch_done;     // PIO only: sectors of this batch already transferred
+    uint8 dma;             // Command in flight uses the bus-master engine
+};
+
+// Looks for a PCI bus-master IDE controller; PIO is used if there is none
+void ata_init_dma();
+
+// Unmasks IRQ14 (and the cascade) at the PIC
+void ata_init_irq();
+
+// Queues 'req' (its lba/count/buffer/write/callback fields set by the caller).
+// Returns ATA_OK, or ATA_ERR_* with the request left untouched.
+int ata_submit(struct ATARequest* req);
+
+// Returns 1 once 'req' is DONE or ERROR
+int ata_request_finished(struct ATARequest* req);
+
+// Busy-waits for 'req', driving the queue by polling so it also works with
+// interrupts disabled (e.g. inside a fault handler). Returns its final status.
+int ata_wait(struct ATARequest* req);
+
+// IRQ14 entry, called by isr_ata_wrapper
+void ata_irq_handler();
+
+// Synchronous wrappers: read/write 'count' sectors starting at 'lba'
 void ata_read_sectors(uint32 lba, uint32 count, void* buffer);
+void ata_write_sectors(uint32 lba, uint32 count, void* buffer);
 #endif
\ No newline at end of file
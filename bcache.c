@@ -0,0 +1,192 @@
+// bcache.c
+// Callers are the fault handler and boot code, so nothing here runs
+// concurrently; IRQ14 only ever flips the status of readahead requests.
+#include "bcache.h"
+#include "mem.h"
+
+struct CacheBlock cache_blocks[BCACHE_BLOCKS];
+struct BlockCacheStats bcache_stats;
+uint32 clock_hand = 0;
+uint32 sequential_next = 0xFFFFFFFF; // Block a sequential reader would ask for next
+int bcache_ready = 0;
+
+// Allocates the block pages on first use. Returns 0 if the heap is out of
+// space; the cache is bypassed then.
+int bcache_init() {
+    if (bcache_ready)
+        return bcache_ready > 0;
+
+    uint8* pages = (uint8*)alloc_pages(BCACHE_BLOCKS);
+    if (!pages) {
+        bcache_ready = -1;
+        return 0;
+    }
+
+    for (int i = 0; i < BCACHE_BLOCKS; i++) {
+        cache_blocks[i].state = BCACHE_EMPTY;
+        cache_blocks[i].data = pages + i * 4096;
+    }
+    bcache_ready = 1;
+    return 1;
+}
+
+// Settles a finished readahead: VALID, or EMPTY if the disk reported an error
+void bcache_settle(struct CacheBlock* block) {
+    if (block->state == BCACHE_LOADING && ata_request_finished(&block->request))
+        block->state = (block->request.status == ATA_REQ_DONE) ? BCACHE_VALID : BCACHE_EMPTY;
+}
+
+struct CacheBlock* bcache_lookup(uint32 lba) {
+    for (int i = 0; i < BCACHE_BLOCKS; i++) {
+        struct CacheBlock* block = &cache_blocks[i];
+        bcache_settle(block);
+        if (block->state != BCACHE_EMPTY && block->lba == lba)
+            return block;
+    }
+    return 0;
+}
+
+// CLOCK: sweep, giving referenced blocks a second chance. Blocks with a
+// readahead in flight are never taken (the disk is still writing them).
+struct CacheBlock* bcache_evict() {
+    for (int i = 0; i < BCACHE_BLOCKS * 2; i++) {
+        struct CacheBlock* block = &cache_blocks[clock_hand];
+        clock_hand = (clock_hand + 1) % BCACHE_BLOCKS;
+
+        bcache_settle(block);
+        if (block->state == BCACHE_LOADING)
+            continue;
+        if (block->state == BCACHE_VALID && block->referenced) {
+            block->referenced = 0;
+            continue;
+        }
+
+        if (block->state == BCACHE_VALID)
+            bcache_stats.evictions++;
+        block->state = BCACHE_EMPTY;
+        return block;
+    }
+
+    // Everything is in flight: wait for the slot under the hand
+    struct CacheBlock* block = &cache_blocks[clock_hand];
+    clock_hand = (clock_hand + 1) % BCACHE_BLOCKS;
+    ata_wait(&block->request);
+    bcache_stats.evictions++;
+    block->state = BCACHE_EMPTY;
+    return block;
+}
+
+// Queues the blocks after 'lba' that are not cached yet
+void bcache_readahead(uint32 lba) {
+    for (int i = 1; i <= BCACHE_READAHEAD; i++) {
+        uint32 next = lba + i * BCACHE_SECTORS;
+        if (bcache_lookup(next))
+            continue;
+
+        struct CacheBlock* block = bcache_evict();
+        block->lba = next;
+        block->referenced = 0;
+        block->prefetched = 1;
+        block->request.lba = next;
+        block->request.count = BCACHE_SECTORS;
+        block->request.buffer = block->data;
+        block->request.write = 0;
+        block->request.callback = 0;
+
+        if (ata_submit(&block->request) != ATA_OK)
+            return; // Queue full, the slot stays EMPTY
+        block->state = BCACHE_LOADING;
+        bcache_stats.readahead++;
+    }
+}
+
+// Returns the cached copy of the block starting at 'lba', reading it if needed
+struct CacheBlock* bcache_get(uint32 lba) {
+    struct CacheBlock* block = bcache_lookup(lba);
+
+    if (block && block->state == BCACHE_LOADING) {
+        // Prefetched but not landed yet
+        ata_wait(&block->request);
+        bcache_settle(block);
+        if (block->state == BCACHE_EMPTY)
+            block = 0;
+    }
+
+    if (block) {
+        if (block->prefetched)
+            bcache_stats.readahead_hits++;
+        bcache_stats.hits++;
+    } else {
+        bcache_stats.misses++;
+        block = bcache_evict();
+        block->lba = lba;
+        ata_read_sectors(lba, BCACHE_SECTORS, block->data);
+        block->state = BCACHE_VALID;
+    }
+    block->referenced = 1;
+    block->prefetched = 0;
+
+    // Sequential reader: keep the next blocks coming while it consumes this one
+    if (lba == sequential_next)
+        bcache_readahead(lba);
+    sequential_next = lba + BCACHE_SECTORS;
+
+    return block;
+}
+
+void bcache_read(uint32 lba, uint32 count, void* buffer) {
+    if (!bcache_init()) {
+        ata_read_sectors(lba, count, buffer);
+        return;
+    }
+
+    char* dest = (char*)buffer;
+    while (count > 0) {
+        uint32 first = lba & ~(BCACHE_SECTORS - 1);
+        uint32 skip = lba - first;
+        uint32 chunk = BCACHE_SECTORS - skip;
+        if (chunk > count)
+            chunk = count;
+
+        struct CacheBlock* block = bcache_get(first);
+        memcpy(dest, (char*)block->data + skip * 512, chunk * 512);
+
+        dest += chunk * 512;
+        lba += chunk;
+        count -= chunk;
+    }
+}
+
+void bcache_write(uint32 lba, uint32 count, void* buffer) {
+    ata_write_sectors(lba, count, buffer);
+    if (bcache_ready <= 0)
+        return;
+
+    // Refresh every cached block the write overlaps
+    for (int i = 0; i < BCACHE_BLOCKS; i++) {
+        struct CacheBlock* block = &cache_blocks[i];
+        if (block->state == BCACHE_EMPTY)
+            continue;
+        if (block->lba + BCACHE_SECTORS <= lba || block->lba >= lba + count)
+            continue;
+
+        // A readahead of this block may have fetched the old data
+        if (block->state == BCACHE_LOADING)
+            ata_wait(&block->request);
+        bcache_settle(block);
+        if (block->state != BCACHE_VALID)
+            continue;
+
+        uint32 start = (block->lba > lba) ? block->lba : lba;
+        uint32 end = (block->lba + BCACHE_SECTORS < lba + count) ? block->lba + BCACHE_SECTORS : lba + count;
+        memcpy((char*)block->data + (start - block->lba) * 512,
+               (char*)buffer + (start - lba) * 512, (end - start) * 512);
+    }
+}
+
+void get_bcache_stats(struct BlockCacheStats* out, int reset) {
+    if (out)
+        memcpy(out, &bcache_stats, sizeof(struct BlockCacheStats));
+    if (reset)
+        memset(&bcache_stats, 0, sizeof(struct BlockCacheStats));
+}
@@ -0,0 +1,43 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+// bcache.h
+
+#include "kernel.h"
+#include "ata.h"
+
+// Block cache in front of the ATA driver. Blocks are one page (8 sectors,
+// aligned to 8 sectors), kept in heap pages and evicted with CLOCK.
+#define BCACHE_BLOCKS     32
+#define BCACHE_SECTORS    8
+#define BCACHE_READAHEAD  4  // Blocks prefetched ahead of a sequential reader
+
+#define BCACHE_EMPTY      0
+#define BCACHE_LOADING    1  // Readahead in flight
+#define BCACHE_VALID      2
+
+struct CacheBlock {
+    uint32 lba;                 // First sector
+    uint8 state;                // BCACHE_*
+    uint8 referenced;           // CLOCK bit, set on every hit
+    uint8 prefetched;           // Brought in by readahead and not used yet
+    uint8* data;                // 4KB, identity mapped (DMA target)
+    struct ATARequest request;  // Readahead request while LOADING
+};
+
+// Readable from the guest with SYSCALL_BCACHE_STATS
+struct BlockCacheStats {
+    uint32 hits;
+    uint32 misses;
+    uint32 readahead;           // Blocks prefetched
+    uint32 readahead_hits;      // Prefetched blocks that were used
+    uint32 evictions;
+};
+
+// Same interface as ata_read_sectors/ata_write_sectors.
+// Writes go through to the disk and update cached copies.
+void bcache_read(uint32 lba, uint32 count, void* buffer);
+void bcache_write(uint32 lba, uint32 count, void* buffer);
+
+// Copies the counters to 'out' (if not 0), then clears them if 'reset'
+void get_bcache_stats(struct BlockCacheStats* out, int reset);
+#endif
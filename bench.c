@@ -0,0 +1,134 @@
+// bench.c
+#include "bench.h"
+#include "serial.h"
+#include "ports.h"
+#include "print.h"
+#include "hook.h"
+#include "acpi.h"
+#include "fs.h"
+#include "trace.h"
+
+struct BootPhase {
+    const char* name;
+    uint64 tsc;
+};
+
+struct BootPhase boot_phases[BENCH_MAX_PHASES];
+int boot_phase_count = 0;
+
+const char* bench_app_name = "kernel"; // "app" field of the JSON lines
+
+// Latch-only registers: the cost measured is the trap path itself
+struct MMIORegister bench_registers[] = {
+    // offset, width, read, write, reset
+    {  0x00,   4,     0,    0,     0x00000000 },
+};
+
+void bench_boot_phase(const char* name) {
+    if (boot_phase_count == BENCH_MAX_PHASES)
+        return;
+    boot_phases[boot_phase_count].name = name;
+    boot_phases[boot_phase_count].tsc = rdtsc();
+    boot_phase_count++;
+}
+
+void serial_print(const char* str) {
+    while (*str)
+        serial_write_byte(*str++);
+}
+
+// Decimal output without 64-bit division (no libgcc here):
+// long division by 10 over 16-bit limbs
+void serial_print_dec(uint64 n) {
+    char digits[20];
+    int count = 0;
+    uint32 limbs[4] = { (uint32)(n >> 48) & 0xFFFF, (uint32)(n >> 32) & 0xFFFF,
+                        (uint32)(n >> 16) & 0xFFFF, (uint32)n & 0xFFFF };
+
+    do {
+        uint32 rem = 0;
+        int zero = 1;
+        for (int i = 0; i < 4; i++) {
+            uint32 cur = (rem << 16) | limbs[i];
+            limbs[i] = cur / 10;
+            rem = cur % 10;
+            if (limbs[i])
+                zero = 0;
+        }
+        digits[count++] = '0' + rem;
+        if (zero)
+            break;
+    } while (1);
+
+    while (count)
+        serial_write_byte(digits[--count]);
+}
+
+void bench_result(const char* name, uint64 cycles) {
+    // One line, not split by trace blocks or console output
+    uint32 flags = irq_save();
+    serial_print("{\"app\":\"");
+    serial_print(bench_app_name);
+    serial_print("\",\"bench\":\"");
+    serial_print(name);
+    serial_print("\",\"cycles\":");
+    serial_print_dec(cycles);
+    serial_print("}\n");
+    irq_restore(flags);
+}
+
+int is_bench_file(struct FSFile* file) {
+    const char* prefix = "bench_";
+    for (int i = 0; prefix[i]; i++) {
+        if (file->name[i] != prefix[i])
+            return 0;
+    }
+    return 1;
+}
+
+void run_benchmarks() {
+    struct FSFile file;
+    int found = 0;
+    for (int i = 0; fs_get(i, &file); i++)
+        found |= is_bench_file(&file);
+    if (!found)
+        return;
+
+    // COM1 is for the JSON lines only; binary trace blocks would corrupt them
+    trace_disable();
+
+    // 1. Boot phases, each relative to the previous mark
+    char name[32];
+    for (int i = 1; i < boot_phase_count; i++) {
+        const char* src = boot_phases[i].name;
+        int n = 0;
+        name[n++] = 'b'; name[n++] = 'o'; name[n++] = 'o'; name[n++] = 't'; name[n++] = '/';
+        while (*src && n < sizeof(name) - 1)
+            name[n++] = *src++;
+        name[n] = 0;
+        bench_result(name, boot_phases[i].tsc - boot_phases[i - 1].tsc);
+    }
+
+    if (register_mmio_hook(BENCH_DEVICE_ADDR, bench_registers, 1) != HOOK_OK)
+        print("ERR: Bench device registration failed\n");
+
+    // 2. Every bench app, in FS order
+    for (int i = 0; fs_get(i, &file); i++) {
+        if (!is_bench_file(&file))
+            continue;
+
+        bench_app_name = file.name;
+        run_app(&file);
+
+        // The next app overwrites this one's code, drop its timer callback
+        user_timer_callback = 0;
+    }
+
+    serial_print("{\"done\":true}\n");
+
+    // 3. Leave QEMU (exit status (0 << 1) | 1); on real hardware, power off.
+    // COM1 output is interrupt driven, let it drain first.
+    serial_flush();
+    outb(BENCH_EXIT_PORT, 0);
+    acpi_shutdown();
+}
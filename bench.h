@@ -0,0 +1,27 @@
+#ifndef BENCH_H
+#define BENCH_H
+// bench.h
+
+#include "kernel.h"
+
+// --- BENCHMARK MODE ---
+// When the FS holds bench_*.bin apps (build_fs.py --bench), the kernel runs
+// each of them in turn, prints results as JSON lines on COM1 and exits QEMU
+// through the isa-debug-exit device.
+//
+// One line per result:
+//   {"app":"bench_mmio.bin","bench":"hooked_read","cycles":1234}
+
+#define BENCH_DEVICE_ADDR 0x1F1000 // Hooked page the bench apps poke (latch-only registers)
+#define BENCH_EXIT_PORT   0xF4     // QEMU -device isa-debug-exit,iobase=0xf4
+#define BENCH_MAX_PHASES  16
+
+// Marks the end of a boot phase (rdtsc). Reported as boot/<name> in bench mode.
+void bench_boot_phase(const char* name);
+
+// Emits one JSON result line on COM1
+void bench_result(const char* name, uint64 cycles);
+
+// Runs all bench_*.bin files and exits QEMU. Returns if there are none.
+void run_benchmarks();
+#endif
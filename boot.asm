@@ -31,21 +31,12 @@ load_kernel:
     int 0x13             ; If this fails, the next read will likely fail too, but we proceed.
     jc disk_error        ; Jump if error (Carry Flag set)
     ; Target Address: 0x10000
-    ; In Real Mode, we use Segment:Offset (ES:BX)
-    ; 0x1000 * 16 + 0x0000 = 0x10000
-    mov ax, 0x1000
-    mov es, ax       ; Set Extra Segment to 0x1000
-    xor bx, bx       ; Set Offset (BX) to 0
-
-; --- THE FIX ---
-    ; Read all 31 sectors in ONE go.
-    ; This avoids the loop logic where CL/CX registers conflict.
-    mov ah, 0x02         ; BIOS Read Sector
-    mov al, 31           ; Size of your kernel (sectors)
-    mov ch, 0x00         ; Cylinder 0
-    mov dh, 0x00         ; Head 0
-    mov cl, 0x02         ; Start at Sector 2 (Sector 1 is bootloader)
+    ; Read the kernel area with the LBA extension (AH=0x42).
+    ; A plain CHS read stops at the end of the first track (62 sectors),
+    ; the kernel area is 127 sectors (KERNEL_SECTORS in build_fs.py).
+    mov ah, 0x42
     mov dl, [BOOT_DRIVE] ; Drive ID
+    mov si, kernel_dap   ; DS:SI -> Disk Address Packet
     int 0x13             ; Call BIOS
     jc disk_error
 
@@ -89,6 +80,15 @@ init_pm:
 
 BOOT_DRIVE db 0
 
+; Disk Address Packet for the kernel read
+kernel_dap:
+    db 0x10              ; Packet size
+    db 0                 ; Reserved
+    dw 127               ; Sectors to read (BIOS limit per call)
+    dw 0x0000            ; Buffer offset
+    dw 0x1000            ; Buffer segment -> 0x10000
+    dq 1                 ; Start LBA (LBA 0 is this bootloader)
+
 ; Padding
 times 510-($-$$) db 0
 dw 0xaa55
\ No newline at end of file
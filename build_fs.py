@@ -2,7 +2,9 @@
 
 import struct
 import os
+import sys
 import time
+import zlib
 
 # --- Configuration ---
 # ENSURE THESE PATHS ARE CORRECT FOR YOUR PROJECT
@@ -11,18 +13,36 @@ KERNEL     = "build/kernel.bin"    # The raw compiled C kernel (NO bootloader at
 OUTPUT_DISK = "build/os_with_fs.vhd"       # The final file we will boot
 
 # Files to put inside the OS
-# Format: (Virtual Filename, Real Path)
+# Format: (Virtual Filename, Real Path[, Flags]); flags default to FILE_EXEC
 FILES = [
     ("app.bin", "app/build/user_app.bin")
 ]
 
+# Benchmark image (python3 build_fs.py --bench): same kernel, the kernel runs
+# every bench_*.bin in order and reports over COM1
+BENCH_OUTPUT_DISK = "build/os_bench.vhd"
+BENCH_FILES = [
+    ("bench_mmio.bin", "app/build/bench_mmio.bin"),
+    ("bench_sys.bin", "app/build/bench_sys.bin"),
+    ("bench_timer.bin", "app/build/bench_timer.bin"),
+]
+
 # Disk Geometry (10MB)
 CYLINDERS = 20
 HEADS = 16
 SECTORS = 63
 DISK_SIZE = CYLINDERS * HEADS * SECTORS * 512
-# This must match 'mov al, 63' in boot.asm
-KERNEL_SECTORS = 63
+# This must match the sector count in boot.asm's kernel_dap
+KERNEL_SECTORS = 127
+
+# FS image format (see fs.h). Version 2 is written unless --v1 is given.
+FS_V2_MAGIC = b'FS2\x00'
+FS_NO_ENTRY = 0xFFFF
+PAGE_SIZE = 4096
+FILE_EXEC = 0x01
+FILE_READONLY = 0x02
+FILE_CHECKSUM = 0x04
+FILE_LZ4 = 0x08
 
 def create_vhd_footer(size):
     footer = bytearray(512)
@@ -72,8 +92,179 @@ def create_vhd_footer(size):
 
     return footer
 
-def build():
-    print(f"Building {OUTPUT_DISK}...")
+def fs_hash(name):
+    # FNV-1a, same as fs_hash() in fs.c
+    h = 2166136261
+    for b in name.rstrip(b'\x00'):
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    return h
+
+def align_page(n):
+    return (n + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1)
+
+def load_files(files):
+    loaded = []
+    for entry in files:
+        vname, real_path = entry[0], entry[1]
+        flags = entry[2] if len(entry) > 2 else FILE_EXEC
+        try:
+            with open(real_path, 'rb') as f:
+                loaded.append((vname.encode('ascii')[:16].ljust(16, b'\x00'), f.read(), flags))
+            print(f" + Added {vname}")
+        except FileNotFoundError:
+            print(f" ! Warning: {real_path} not found. Skipping.")
+    return loaded
+
+def build_fs_v1(files):
+    # FS Header: Magic 'FS' + File Count (2 bytes)
+    fs_header = b'FS' + struct.pack('<H', len(files))
+    fs_body = b''
+    current_offset = 0
+
+    for entry_name, file_content, _ in files:
+        # Entry: Name(16) + Size(4) + Offset(4)
+        fs_header += entry_name
+        fs_header += struct.pack('<I', len(file_content))
+        fs_header += struct.pack('<I', current_offset)
+
+        fs_body += file_content
+        current_offset += len(file_content)
+
+    return fs_header + fs_body
+
+def lz4_compress_block(src):
+    # Greedy LZ4 block compressor (format only, no frame). Follows the
+    # end-of-block rules: the last 5 bytes are literals and no match starts
+    # in the last 12, so any LZ4 decoder accepts the output.
+    out = bytearray()
+
+    def put_length(n):
+        while n >= 255:
+            out.append(255)
+            n -= 255
+        out.append(n)
+
+    def put_sequence(literals, offset=None, match_len=0):
+        lit = min(len(literals), 15)
+        ml = min(match_len - 4, 15) if offset is not None else 0
+        out.append((lit << 4) | ml)
+        if lit == 15:
+            put_length(len(literals) - 15)
+        out.extend(literals)
+        if offset is not None:
+            out.extend(struct.pack('<H', offset))
+            if ml == 15:
+                put_length(match_len - 4 - 15)
+
+    n = len(src)
+    match_limit = n - 5
+    table = {}
+    anchor = 0
+    i = 0
+    while i < n - 12:
+        key = src[i:i + 4]
+        candidate = table.get(key)
+        table[key] = i
+        if candidate is None or i - candidate > 0xFFFF:
+            i += 1
+            continue
+
+        length = 4
+        while i + length < match_limit and src[candidate + length] == src[i + length]:
+            length += 1
+        put_sequence(src[anchor:i], i - candidate, length)
+        # Index the positions the match skipped, later matches find them too
+        for j in range(i + 1, min(i + length, n - 12)):
+            table[src[j:j + 4]] = j
+        i += length
+        anchor = i
+
+    put_sequence(src[anchor:])
+    return bytes(out)
+
+def compress_file(content):
+    # Block table (one uint32 offset per page, plus the end) followed by one
+    # independently decodable block per 4KB page. A block as long as its
+    # page is stored as is (compression did not pay off).
+    blocks = []
+    for pos in range(0, len(content), PAGE_SIZE):
+        page = content[pos:pos + PAGE_SIZE]
+        packed = lz4_compress_block(page)
+        blocks.append(packed if len(packed) < len(page) else page)
+
+    table_size = 4 * (len(blocks) + 1)
+    offsets = [table_size]
+    for block in blocks:
+        offsets.append(offsets[-1] + len(block))
+    return struct.pack(f'<{len(offsets)}I', *offsets) + b''.join(blocks)
+
+def build_fs_v2(files, compress=False, checksum=False):
+    # Returns (disk image, size in memory).
+    #
+    # In memory (the kernel's FS window): header (28 bytes) | directory |
+    # hash buckets | pad | files, each on its own page.
+    # On disk: the same metadata, then each file's contents starting on a
+    # page; compressed files are a block table plus LZ4 blocks (see fs.h).
+    # The CRC32 is always stored; with 'checksum' every file also gets
+    # FILE_CHECKSUM, which makes the kernel read the whole file before use.
+    HEADER = struct.Struct('<4sHHIIIII')
+    ENTRY = struct.Struct('<16sIIIIHHI')
+
+    bucket_count = 8
+    while bucket_count < 2 * len(files):
+        bucket_count *= 2
+
+    dir_offset = HEADER.size
+    hash_offset = dir_offset + ENTRY.size * len(files)
+    data_offset = align_page(hash_offset + 2 * bucket_count)
+
+    # 1. Place the files, each on its own page (in memory and on disk)
+    offsets = []
+    disk_offsets = []
+    payloads = []
+    current_offset = data_offset
+    disk_offset = data_offset
+    for i, (_, file_content, flags) in enumerate(files):
+        payload = file_content
+        if compress and file_content:
+            payload = compress_file(file_content)
+            if len(payload) < len(file_content):
+                files[i] = (files[i][0], file_content, flags | FILE_LZ4)
+            else:
+                payload = file_content
+
+        offsets.append(current_offset)
+        disk_offsets.append(disk_offset)
+        payloads.append(payload)
+        current_offset = align_page(current_offset + len(file_content))
+        disk_offset = align_page(disk_offset + len(payload))
+    total_size = current_offset
+
+    # 2. Hash chains: each new entry goes in front of its bucket's chain
+    buckets = [FS_NO_ENTRY] * bucket_count
+    nexts = []
+    for i, (entry_name, _, _) in enumerate(files):
+        b = fs_hash(entry_name) & (bucket_count - 1)
+        nexts.append(buckets[b])
+        buckets[b] = i
+
+    image = bytearray(disk_offset)
+    HEADER.pack_into(image, 0, FS_V2_MAGIC, 2, len(files), bucket_count,
+                     dir_offset, hash_offset, data_offset, total_size)
+    for i, (entry_name, file_content, flags) in enumerate(files):
+        ENTRY.pack_into(image, dir_offset + i * ENTRY.size, entry_name, len(file_content),
+                        offsets[i], flags | (FILE_CHECKSUM if checksum else 0), zlib.crc32(file_content),
+                        nexts[i], 0, disk_offsets[i])
+        image[disk_offsets[i]:disk_offsets[i] + len(payloads[i])] = payloads[i]
+        if flags & FILE_LZ4:
+            name = entry_name.rstrip(b'\x00').decode()
+            print(f"   {name}: {len(file_content)} -> {len(payloads[i])} bytes (LZ4)")
+    struct.pack_into(f'<{bucket_count}H', image, hash_offset, *buckets)
+
+    return bytes(image), total_size
+
+def build(output_disk, files, fs_version=2, compress=False, checksum=False):
+    print(f"Building {output_disk}...")
 
     # 1. Load Bootloader
     with open(BOOTLOADER, 'rb') as f:
@@ -98,33 +289,21 @@ def build():
     data += kernel_data
     data += b'\x00' * (KERNEL_AREA_SIZE - len(kernel_data))
 
-    # Sector 64: Filesystem Start
+    # Sector 128: Filesystem Start
     print(f"Kernel ends at offset {len(data)}. Adding Filesystem...")
 
-    # FS Header: Magic 'FS' + File Count (2 bytes)
-    fs_header = b'FS' + struct.pack('<H', len(FILES))
-    fs_body = b''
-    current_offset = 0
-
-    for vname, real_path in FILES:
-        try:
-            with open(real_path, 'rb') as f:
-                file_content = f.read()
-
-            # Entry: Name(16) + Size(4) + Offset(4)
-            entry_name = vname.encode('ascii')[:16].ljust(16, b'\x00')
-            fs_header += entry_name
-            fs_header += struct.pack('<I', len(file_content))
-            fs_header += struct.pack('<I', current_offset)
+    loaded = load_files(files)
+    if fs_version == 1:
+        fs_image = build_fs_v1(loaded)
+        fs_size = len(fs_image)
+    else:
+        fs_image, fs_size = build_fs_v2(loaded, compress, checksum)
 
-            fs_body += file_content
-            current_offset += len(file_content)
-            print(f" + Added {vname}")
-        except FileNotFoundError:
-            print(f" ! Warning: {real_path} not found. Skipping.")
-
-    data += fs_header
-    data += fs_body
+    # Must fit the window the kernel reserves at 0x200000 (FS_MAX_SECTORS in fs.h)
+    if fs_size > 2500 * 512:
+        print(f"ERROR: Filesystem too large! ({fs_size} > {2500 * 512})")
+        return
+    data += fs_image
 
     # 4. Pad to Disk Size
     if len(data) > DISK_SIZE:
@@ -135,10 +314,19 @@ def build():
     # 5. Append VHD Footer
     data += create_vhd_footer(DISK_SIZE)
 
-    with open(OUTPUT_DISK, 'wb') as f:
+    with open(output_disk, 'wb') as f:
         f.write(data)
 
     print("Done.")
 
 if __name__ == "__main__":
-    build()
\ No newline at end of file
+    # --lz4: compress file contents (version 2 only)
+    # --checksum: verify every file against its CRC32 before it runs. Off by
+    # default: the check pages in (and decodes) the whole file at load time.
+    fs_version = 1 if "--v1" in sys.argv else 2
+    compress = "--lz4" in sys.argv
+    checksum = "--checksum" in sys.argv
+    if "--bench" in sys.argv:
+        build(BENCH_OUTPUT_DISK, BENCH_FILES, fs_version, compress, checksum)
+    else:
+        build(OUTPUT_DISK, FILES, fs_version, compress, checksum)
\ No newline at end of file
@@ -0,0 +1,112 @@
+// console.c
+#include "console.h"
+#include "mem.h"
+#include "serial.h"
+
+char console_ring[CONSOLE_RING_SIZE];
+volatile uint32 console_head = 0; // Next character to append
+volatile uint32 console_tail = 0; // Next character to render
+
+int console_mirror = CONSOLE_MIRROR_SERIAL;
+
+// What the screen should show; rows in 'console_dirty' differ from VGA memory
+uint16 console_screen[VGA_ROWS * VGA_COLS];
+uint32 console_dirty = 0xFFFFFFFF;  // Bit n = row n. Starts all dirty: the
+                                    // BIOS left its own text on the screen
+int cursor_x = 0;
+int cursor_y = 0;
+uint32 console_flush_tick = 0;
+
+void console_scroll() {
+    uint16 blank = 0x20 | (WHITE_ON_BLACK << 8);
+    memmove(console_screen, console_screen + VGA_COLS, (VGA_ROWS - 1) * VGA_COLS * 2);
+    memsetw(console_screen + (VGA_ROWS - 1) * VGA_COLS, blank, VGA_COLS);
+    cursor_y = VGA_ROWS - 1;
+    console_dirty = 0xFFFFFFFF;
+}
+
+// Applies one character to the back buffer
+void console_render(char c) {
+    uint16 blank = 0x20 | (WHITE_ON_BLACK << 8);
+
+    if (c == CONSOLE_CLEAR) {
+        memsetw(console_screen, blank, VGA_ROWS * VGA_COLS);
+        cursor_x = 0;
+        cursor_y = 0;
+        console_dirty = 0xFFFFFFFF;
+        return;
+    }
+
+    if (c == '\n') {
+        cursor_x = 0;
+        cursor_y++;
+    } else {
+        console_screen[cursor_y * VGA_COLS + cursor_x] = (uint8)c | (WHITE_ON_BLACK << 8);
+        console_dirty |= 1 << cursor_y;
+        cursor_x++;
+    }
+
+    if (cursor_x >= VGA_COLS) {
+        cursor_x = 0;
+        cursor_y++;
+    }
+    if (cursor_y >= VGA_ROWS)
+        console_scroll();
+}
+
+// Renders the ring into the back buffer (and COM1). Interrupts are off.
+void console_drain() {
+    while (console_tail != console_head) {
+        char c = console_ring[console_tail & (CONSOLE_RING_SIZE - 1)];
+        console_tail++;
+        console_render(c);
+        if (console_mirror && c != CONSOLE_CLEAR)
+            serial_write_byte(c);
+    }
+}
+
+void console_putc(char c) {
+    uint32 flags = irq_save();
+    // Full (lots of output and nobody flushing): render into the back
+    // buffer now, which is still only memory traffic
+    if (console_head - console_tail == CONSOLE_RING_SIZE)
+        console_drain();
+    console_ring[console_head & (CONSOLE_RING_SIZE - 1)] = c;
+    console_head++;
+    irq_restore(flags);
+}
+
+void console_write(const char* str) {
+    // Reading 'str' may fault (guest strings in lazy FS pages); the fault
+    // handler may print too, so no ring state is kept across the loop
+    while (*str)
+        console_putc(*str++);
+}
+
+void console_flush() {
+    uint16* video_memory = (uint16*)VGA_ADDRESS;
+
+    // Interrupts off: the timer tick flushes too, and both share the back buffer
+    uint32 flags = irq_save();
+
+    console_drain();
+
+    if ((console_dirty & ((1 << VGA_ROWS) - 1)) == (1 << VGA_ROWS) - 1) {
+        // After a scroll every row changed: one copy of the whole screen
+        memcpy(video_memory, console_screen, sizeof(console_screen));
+    } else {
+        for (int row = 0; row < VGA_ROWS; row++) {
+            if (console_dirty & (1 << row))
+                memcpy(video_memory + row * VGA_COLS, console_screen + row * VGA_COLS, VGA_COLS * 2);
+        }
+    }
+    console_dirty = 0;
+    console_flush_tick = tick_counter;
+
+    irq_restore(flags);
+}
+
+void console_tick() {
+    if (tick_counter - console_flush_tick >= CONSOLE_FLUSH_TICKS)
+        console_flush();
+}
@@ -0,0 +1,35 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+// console.h
+
+#include "kernel.h"
+
+// --- BUFFERED CONSOLE ---
+// print() and friends only append characters to a ring, which is cheap
+// enough for fault and interrupt handlers. console_flush() renders the ring
+// into a back buffer and copies just the lines that changed to VGA memory.
+// It runs from the idle loop and every CONSOLE_FLUSH_TICKS timer ticks.
+#define CONSOLE_RING_SIZE     4096 // Must be a power of two
+#define CONSOLE_FLUSH_TICKS   400  // 20ms at 50us per tick
+#define CONSOLE_MIRROR_SERIAL 0    // 1 = also send everything to COM1. Off by
+                                   // default: COM1 carries trace and bench data
+
+#define CONSOLE_CLEAR '\f'         // In the ring: clear the screen
+
+#define VGA_ADDRESS    0xB8000
+#define VGA_COLS       80
+#define VGA_ROWS       25
+#define WHITE_ON_BLACK 0x0F
+
+extern int console_mirror; // Starts as CONSOLE_MIRROR_SERIAL
+
+void console_putc(char c);
+void console_write(const char* str);
+
+// Renders everything queued so far and updates the screen.
+// Call before halting for good, or the last lines never show up.
+void console_flush();
+
+// Timer hook: flushes if CONSOLE_FLUSH_TICKS have passed since the last flush
+void console_tick();
+#endif
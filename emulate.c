@@ -0,0 +1,258 @@
+// emulate.c
+// Decodes the faulting instruction and performs its memory access directly
+// against the hook, so a trapped access costs one #PF instead of #PF + #DB.
+
+#include "emulate.h"
+
+// EFLAGS bits written by ALU instructions
+#define FLAG_CF 0x001
+#define FLAG_PF 0x004
+#define FLAG_AF 0x010
+#define FLAG_ZF 0x040
+#define FLAG_SF 0x080
+#define FLAG_OF 0x800
+#define ALU_FLAGS (FLAG_CF | FLAG_PF | FLAG_AF | FLAG_ZF | FLAG_SF | FLAG_OF)
+
+uint32 width_mask(int width) {
+    return (width == 4) ? 0xFFFFFFFF : ((1u << (width * 8)) - 1);
+}
+
+// Skips ModRM, SIB and displacement (32-bit addressing).
+// Returns the byte after them, or 0 if the operand is a register (mod == 3).
+uint8* skip_modrm(uint8* p, uint8* reg) {
+    uint8 modrm = *p++;
+    uint8 mod = modrm >> 6;
+    uint8 rm = modrm & 7;
+
+    *reg = (modrm >> 3) & 7;
+    if (mod == 3)
+        return 0;
+
+    if (rm == 4) {
+        uint8 sib = *p++;
+        // SIB with no base register carries a disp32
+        if (mod == 0 && (sib & 7) == 5)
+            p += 4;
+    } else if (mod == 0 && rm == 5) {
+        p += 4; // [disp32]
+    }
+
+    if (mod == 1) p += 1;
+    if (mod == 2) p += 4;
+    return p;
+}
+
+uint8* read_imm(uint8* p, int width, uint32* imm) {
+    if (width == 1) *imm = *p;
+    else if (width == 2) *imm = *(uint16*)p;
+    else *imm = *(uint32*)p;
+    return p + width;
+}
+
+int x86_decode(uint8* code, struct X86Instruction* insn) {
+    uint8* p = code;
+    int opsize = 4;
+
+    // 1. Prefixes: operand size, segment overrides (flat GDT, so no-ops) and LOCK
+    for (;;) {
+        uint8 b = *p;
+        if (b == 0x66) opsize = 2;
+        else if (b != 0x26 && b != 0x2E && b != 0x36 && b != 0x3E &&
+                 b != 0x64 && b != 0x65 && b != 0xF0) break;
+        p++;
+    }
+
+    uint8 opcode = *p++;
+    insn->has_imm = 0;
+    insn->imm = 0;
+    insn->reg = 0;
+
+    // 2. Opcode
+    if (opcode < 0x40 && (opcode & 7) < 4) {
+        // ALU Eb,Gb / Ev,Gv / Gb,Eb / Gv,Ev
+        insn->op = opcode >> 3;
+        insn->width = (opcode & 1) ? opsize : 1;
+        insn->mem_is_dest = !(opcode & 2);
+        p = skip_modrm(p, &insn->reg);
+    } else if (opcode == 0x80 || opcode == 0x81 || opcode == 0x83) {
+        // ALU Eb,Ib / Ev,Iz / Ev,Ib (sign-extended)
+        insn->width = (opcode == 0x80) ? 1 : opsize;
+        insn->mem_is_dest = 1;
+        insn->has_imm = 1;
+        p = skip_modrm(p, &insn->op);
+        if (!p)
+            return 0;
+        if (opcode == 0x83) {
+            insn->imm = (uint32)(int)(signed char)*p++;
+        } else {
+            p = read_imm(p, insn->width, &insn->imm);
+        }
+    } else if (opcode == 0x84 || opcode == 0x85) {
+        insn->op = EMU_TEST;
+        insn->width = (opcode & 1) ? opsize : 1;
+        insn->mem_is_dest = 1;
+        p = skip_modrm(p, &insn->reg);
+    } else if (opcode >= 0x88 && opcode <= 0x8B) {
+        insn->op = EMU_MOV;
+        insn->width = (opcode & 1) ? opsize : 1;
+        insn->mem_is_dest = !(opcode & 2);
+        p = skip_modrm(p, &insn->reg);
+    } else if (opcode >= 0xA0 && opcode <= 0xA3) {
+        // MOV AL/eAX <-> [moffs32]
+        insn->op = EMU_MOV;
+        insn->width = (opcode & 1) ? opsize : 1;
+        insn->mem_is_dest = (opcode & 2) >> 1;
+        p += 4;
+    } else if (opcode == 0xC6 || opcode == 0xC7 || opcode == 0xF6 || opcode == 0xF7) {
+        // MOV Eb,Ib / Ev,Iz (/0) and TEST Eb,Ib / Ev,Iz (/0)
+        uint8 sub;
+        insn->op = (opcode < 0xF0) ? EMU_MOV : EMU_TEST;
+        insn->width = (opcode & 1) ? opsize : 1;
+        insn->mem_is_dest = 1;
+        insn->has_imm = 1;
+        p = skip_modrm(p, &sub);
+        if (!p || sub != 0)
+            return 0;
+        p = read_imm(p, insn->width, &insn->imm);
+    } else if (opcode == 0x0F) {
+        // MOVZX / MOVSX Gv,Eb / Gv,Ew
+        uint8 op2 = *p++;
+        if (op2 != 0xB6 && op2 != 0xB7 && op2 != 0xBE && op2 != 0xBF)
+            return 0;
+        insn->op = (op2 < 0xBE) ? EMU_MOVZX : EMU_MOVSX;
+        insn->width = (op2 & 1) ? 2 : 1;
+        insn->reg_width = opsize;
+        insn->mem_is_dest = 0;
+        p = skip_modrm(p, &insn->reg);
+        if (!p)
+            return 0;
+        insn->length = p - code;
+        return 1;
+    } else {
+        return 0;
+    }
+
+    if (!p || insn->op == EMU_ADC || insn->op == EMU_SBB)
+        return 0;
+
+    insn->reg_width = insn->width;
+    insn->length = p - code;
+    return 1;
+}
+
+// The TrapFrame stores pusha order (EDI first), x86 numbering is EAX first
+uint32 get_reg(struct TrapFrame* tf, int reg, int width) {
+    uint32* regs = &tf->edi;
+    if (width == 1) {
+        uint32 v = regs[7 - (reg & 3)];
+        return (reg & 4) ? (v >> 8) & 0xFF : v & 0xFF;
+    }
+    return regs[7 - reg] & width_mask(width);
+}
+
+void set_reg(struct TrapFrame* tf, int reg, int width, uint32 value) {
+    uint32* regs = &tf->edi;
+    if (width == 1) {
+        uint32* r = &regs[7 - (reg & 3)];
+        if (reg & 4) *r = (*r & ~0xFF00) | ((value & 0xFF) << 8);
+        else         *r = (*r & ~0xFF) | (value & 0xFF);
+    } else if (width == 2) {
+        regs[7 - reg] = (regs[7 - reg] & ~0xFFFF) | (value & 0xFFFF);
+    } else {
+        regs[7 - reg] = value;
+    }
+}
+
+// Computes the ALU result and the arithmetic flags it produces
+uint32 alu(int op, uint32 a, uint32 b, int width, uint32* flags) {
+    uint32 mask = width_mask(width);
+    uint32 sign = 1u << (width * 8 - 1);
+    uint32 res;
+    uint32 f = 0;
+
+    a &= mask;
+    b &= mask;
+
+    switch (op) {
+    case EMU_ADD:
+        res = (a + b) & mask;
+        if (res < a) f |= FLAG_CF;
+        if ((a ^ res) & (b ^ res) & sign) f |= FLAG_OF;
+        if ((a ^ b ^ res) & 0x10) f |= FLAG_AF;
+        break;
+    case EMU_SUB:
+    case EMU_CMP:
+        res = (a - b) & mask;
+        if (a < b) f |= FLAG_CF;
+        if ((a ^ b) & (a ^ res) & sign) f |= FLAG_OF;
+        if ((a ^ b ^ res) & 0x10) f |= FLAG_AF;
+        break;
+    case EMU_OR:  res = a | b; break;
+    case EMU_XOR: res = a ^ b; break;
+    default:      res = a & b; break; // AND, TEST
+    }
+
+    if (res == 0) f |= FLAG_ZF;
+    if (res & sign) f |= FLAG_SF;
+
+    // PF: even number of set bits in the low byte
+    uint8 low = res & 0xFF;
+    low ^= low >> 4;
+    low ^= low >> 2;
+    low ^= low >> 1;
+    if (!(low & 1)) f |= FLAG_PF;
+
+    *flags = f;
+    return res;
+}
+
+int emulate_mmio(struct TrapFrame* tf, struct HookEntry* hook, uint32 address) {
+    struct X86Instruction insn;
+
+    // 1. Everything that can fail is checked before the device sees an access
+    if (!x86_decode((uint8*)tf->eip, &insn))
+        return 0;
+
+    // Access must stay inside the hooked page
+    if ((address & 0xFFF) + insn.width > 4096)
+        return 0;
+
+    // ESP is not part of the pusha frame we can write back
+    if (!insn.has_imm && insn.reg == 4 && insn.reg_width != 1)
+        return 0;
+
+    // 2. Perform the access
+    if (insn.op == EMU_MOV && insn.mem_is_dest) {
+        uint32 src = insn.has_imm ? insn.imm : get_reg(tf, insn.reg, insn.width);
+        hook_write(hook, address, insn.width, src);
+    } else if (insn.op == EMU_MOV) {
+        set_reg(tf, insn.reg, insn.width, hook_read(hook, address, insn.width));
+    } else if (insn.op == EMU_MOVZX || insn.op == EMU_MOVSX) {
+        uint32 value = hook_read(hook, address, insn.width);
+        if (insn.op == EMU_MOVSX)
+            value = (insn.width == 1) ? (uint32)(int)(signed char)value
+                                      : (uint32)(int)(short)value;
+        set_reg(tf, insn.reg, insn.reg_width, value);
+    } else {
+        uint32 mem = hook_read(hook, address, insn.width);
+        uint32 src = insn.has_imm ? insn.imm : get_reg(tf, insn.reg, insn.width);
+        uint32 flags;
+        uint32 res;
+
+        if (insn.mem_is_dest) {
+            res = alu(insn.op, mem, src, insn.width, &flags);
+            if (insn.op != EMU_CMP && insn.op != EMU_TEST)
+                hook_write(hook, address, insn.width, res);
+        } else {
+            res = alu(insn.op, src, mem, insn.width, &flags);
+            if (insn.op != EMU_CMP)
+                set_reg(tf, insn.reg, insn.width, res);
+        }
+
+        tf->eflags = (tf->eflags & ~ALU_FLAGS) | flags;
+    }
+
+    // 3. Skip the instruction
+    tf->eip += insn.length;
+    return 1;
+}
@@ -0,0 +1,45 @@
+#ifndef EMULATE_H
+#define EMULATE_H
+// emulate.h
+
+#include "kernel.h"
+#include "hook.h"
+
+// Operations, numbered like the x86 ALU group (opcode bits 5-3 / ModRM.reg)
+#define EMU_ADD   0
+#define EMU_OR    1
+#define EMU_ADC   2 // Not emulated (needs carry in), falls back to single step
+#define EMU_SBB   3 // Not emulated (needs carry in), falls back to single step
+#define EMU_AND   4
+#define EMU_SUB   5
+#define EMU_XOR   6
+#define EMU_CMP   7
+#define EMU_TEST  8
+#define EMU_MOV   9
+#define EMU_MOVZX 10
+#define EMU_MOVSX 11
+
+// One decoded instruction with a memory operand.
+// The memory address itself is not decoded: CR2 already holds it.
+struct X86Instruction {
+    uint8 op;          // EMU_*
+    uint8 width;       // Memory operand width in bytes (1, 2 or 4)
+    uint8 reg_width;   // Register operand width (differs from 'width' for MOVZX/MOVSX)
+    uint8 reg;         // Register operand (ModRM.reg), x86 numbering (0 = EAX/AL)
+    uint8 mem_is_dest; // 1 = memory is the first operand ("OP [mem], src")
+    uint8 has_imm;     // Source is 'imm' instead of 'reg'
+    uint8 length;      // Total instruction length in bytes
+    uint32 imm;
+};
+
+uint32 width_mask(int width);
+
+// Returns 1 and fills 'insn' if the bytes at 'code' are an instruction we can emulate
+int x86_decode(uint8* code, struct X86Instruction* insn);
+
+// Emulates the instruction at tf->eip against 'hook' (fault address 'address'),
+// updating registers, flags and EIP in the TrapFrame.
+// Returns 0 if the instruction is not supported; nothing has been touched then.
+int emulate_mmio(struct TrapFrame* tf, struct HookEntry* hook, uint32 address);
+
+#endif
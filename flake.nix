@@ -34,18 +34,37 @@
             echo "=== 1. Compile Kernel (C) ==="
             gcc -ffreestanding -m32 -fno-pic -fno-leading-underscore -c kernel.c -o build/kernel.o
             gcc -ffreestanding -m32 -fno-pic -fno-leading-underscore -c print.c -o build/print.o
+            gcc -ffreestanding -m32 -fno-pic -fno-leading-underscore -c console.c -o build/console.o
+            gcc -ffreestanding -m32 -fno-pic -fno-leading-underscore -c klog.c -o build/klog.o
+            gcc -ffreestanding -m32 -fno-pic -fno-leading-underscore -c vclock.c -o build/vclock.o
+            gcc -ffreestanding -m32 -fno-pic -fno-leading-underscore -c vtimer.c -o build/vtimer.o
+            gcc -ffreestanding -m32 -fno-pic -fno-leading-underscore -c timer.c -o build/timer.o
             gcc -ffreestanding -m32 -fno-pic -fno-leading-underscore -c ata.c -o build/ata.o
+            gcc -ffreestanding -m32 -fno-pic -fno-leading-underscore -c pci.c -o build/pci.o
+            gcc -ffreestanding -m32 -fno-pic -fno-leading-underscore -c fs.c -o build/fs.o
+            gcc -ffreestanding -m32 -fno-pic -fno-leading-underscore -c bcache.c -o build/bcache.o
+            gcc -ffreestanding -m32 -fno-pic -fno-leading-underscore -c lz4.c -o build/lz4.o
+            gcc -ffreestanding -m32 -fno-pic -fno-leading-underscore -c mem.c -o build/mem.o
             gcc -ffreestanding -m32 -fno-pic -fno-leading-underscore -c syscalls.c -o build/syscalls.o
+            gcc -ffreestanding -m32 -fno-pic -fno-leading-underscore -c ioring.c -o build/ioring.o
+            gcc -ffreestanding -m32 -fno-pic -fno-leading-underscore -c vdso.c -o build/vdso.o
+            gcc -ffreestanding -m32 -fno-pic -fno-leading-underscore -c smp.c -o build/smp.o
             gcc -ffreestanding -m32 -fno-pic -fno-leading-underscore -c acpi.c -o build/acpi.o
+            gcc -ffreestanding -m32 -fno-pic -fno-leading-underscore -c emulate.c -o build/emulate.o
+            gcc -ffreestanding -m32 -fno-pic -fno-leading-underscore -c serial.c -o build/serial.o
+            gcc -ffreestanding -m32 -fno-pic -fno-leading-underscore -c trace.c -o build/trace.o
+            gcc -ffreestanding -m32 -fno-pic -fno-leading-underscore -c bench.c -o build/bench.o
 
             echo "=== 2. Assemble Entry (ASM) ==="
             nasm -f elf32 kernel_entry.asm -o build/kernel_entry.o
             nasm -f elf32 interrupts.asm -o build/interrupts.o
+            nasm -f elf32 smp_trampoline.asm -o build/smp_trampoline.o
 
             echo "=== 3. Link Kernel ==="
             ld -m elf_i386 -T link.ld --image-base 0 -o build/kernel.tmp \
               build/kernel_entry.o build/interrupts.o build/kernel.o \
-              build/print.o build/ata.o build/syscalls.o build/acpi.o
+              build/print.o build/console.o build/klog.o build/vclock.o build/vtimer.o build/timer.o build/ata.o build/pci.o build/fs.o build/bcache.o build/lz4.o build/mem.o build/syscalls.o build/ioring.o build/vdso.o build/smp.o build/acpi.o build/emulate.o \
+              build/serial.o build/trace.o build/bench.o build/smp_trampoline.o
 
             echo "=== 4. Extract Kernel Binary ==="
             objcopy -O binary build/kernel.tmp build/kernel.bin
@@ -56,25 +75,42 @@
             echo "=== 6. Build User App ==="
             # Compiling application C files (Note: Paths adjusted for root execution)
             gcc -m32 -ffreestanding -fno-pic -c app/user_app.c -o app/build/user_app.o
+            gcc -m32 -ffreestanding -fno-pic -c syscall/entry.c -o app/build/entry_syscall.o
             gcc -m32 -ffreestanding -fno-pic -c syscall/register_timer_handler.c -o app/build/timer_handler_syscall.o
             gcc -m32 -ffreestanding -fno-pic -c syscall/print.c -o app/build/print_syscall.o
+            gcc -m32 -ffreestanding -fno-pic -c syscall/hook_stats.c -o app/build/hook_stats_syscall.o
+            gcc -m32 -ffreestanding -fno-pic -c syscall/bench.c -o app/build/bench_syscall.o
+            gcc -m32 -ffreestanding -fno-pic -c syscall/bcache_stats.c -o app/build/bcache_stats_syscall.o
+            gcc -m32 -ffreestanding -fno-pic -c syscall/ring.c -o app/build/ring_syscall.o
 
             # Link App (ELF format)
             # We use app/app_link.ld but force output to app/build/user_app.tmp
             ld -m elf_i386 -o app/build/user_app.tmp -T app/app_link.ld --image-base 0 \
-               app/build/user_app.o app/build/timer_handler_syscall.o app/build/print_syscall.o
+               app/build/user_app.o app/build/entry_syscall.o app/build/timer_handler_syscall.o app/build/print_syscall.o \
+               app/build/hook_stats_syscall.o app/build/bcache_stats_syscall.o app/build/ring_syscall.o
 
             # Extract App Binary
             # Safe default: dumps all allocatable sections (.text, .data, .rodata)
             objcopy -O binary app/build/user_app.tmp app/build/user_app.bin
 
-            echo "=== 7. Build Filesystem ==="
-            python3 build_fs.py
+            echo "=== 7. Build Benchmark Apps ==="
+            for bench in bench_mmio bench_sys bench_timer; do
+              gcc -m32 -ffreestanding -fno-pic -c app/$bench.c -o app/build/$bench.o
+              ld -m elf_i386 -o app/build/$bench.tmp -T app/app_link.ld --image-base 0 \
+                 app/build/$bench.o app/build/entry_syscall.o app/build/timer_handler_syscall.o app/build/print_syscall.o \
+                 app/build/hook_stats_syscall.o app/build/bench_syscall.o app/build/bcache_stats_syscall.o app/build/ring_syscall.o
+              objcopy -O binary app/build/$bench.tmp app/build/$bench.bin
+            done
+
+            echo "=== 8. Build Filesystem ==="
+            python3 build_fs.py --lz4
+            python3 build_fs.py --bench
           '';
 
           installPhase = ''
             mkdir -p $out
             cp build/os_with_fs.vhd $out/
+            cp build/os_bench.vhd $out/
             
             # Optional: Copy debug symbols
             cp build/kernel.tmp $out/kernel.elf
@@ -96,6 +132,44 @@
           ''}";
         };
 
+        # Same as default, but COM1 goes to mmio_trace.bin and is decoded on exit
+        apps.trace = {
+          type = "app";
+          program = "${pkgs.writeShellScript "trace-os" ''
+            ${pkgs.qemu}/bin/qemu-system-i386 \
+              -drive file=${osPackage}/os_with_fs.vhd,format=vpc,index=0,media=disk,snapshot=on \
+              -serial file:mmio_trace.bin \
+              -display curses
+
+            ${pkgs.python3}/bin/python3 ${./trace_decode.py} mmio_trace.bin
+          ''}";
+        };
+
+        # Headless benchmark run: JSON lines on stdout, QEMU exits by itself
+        # (e.g. nix run .#bench > results.json). Fails if the kernel does not
+        # reach the exit port, or if the run takes longer than 5 minutes.
+        apps.bench = {
+          type = "app";
+          program = "${pkgs.writeShellScript "bench-os" ''
+            ${pkgs.coreutils}/bin/timeout 300 \
+              ${pkgs.qemu}/bin/qemu-system-i386 \
+              -drive file=${osPackage}/os_bench.vhd,format=vpc,index=0,media=disk,snapshot=on \
+              -device isa-debug-exit,iobase=0xf4,iosize=0x04 \
+              -serial stdio \
+              -display none \
+              | ${pkgs.gnugrep}/bin/grep -a --line-buffered '^{'
+            status=''${PIPESTATUS[0]}
+
+            # isa-debug-exit exits with (value << 1) | 1; run_benchmarks writes 0.
+            # Anything else (a plain QEMU exit, a crash, timeout's 124) is a failure.
+            case $status in
+              1) exit 0 ;;
+              124) echo "bench: timed out" >&2; exit 1 ;;
+              *) echo "bench: QEMU exited with status $status" >&2; exit 1 ;;
+            esac
+          ''}";
+        };
+
         devShells.default = pkgs.mkShell {
           buildInputs = [ pkgs.nasm pkgs.python3 pkgs.qemu cc binutils ];
         };
@@ -0,0 +1,306 @@
+// fs.c
+#include "fs.h"
+#include "ata.h"
+#include "bcache.h"
+#include "print.h"
+#include "lz4.h"
+#include "mem.h"
+
+struct ATARequest fs_header_request;
+uint32 fs_pages_loaded = 0;
+int fs_version = 0;
+uint16 fs_files = 0;
+
+// Sectors holding one compressed block: up to 4KB starting anywhere in a sector
+uint8 fs_block_buffer[10 * 512];
+
+void fs_load_start() {
+    fs_header_request.lba = FS_LBA;
+    fs_header_request.count = 8; // One page: the header and the start of the directory
+    fs_header_request.buffer = (void*)FS_BASE;
+    fs_header_request.write = 0;
+    fs_header_request.callback = 0;
+    ata_submit(&fs_header_request);
+}
+
+int fs_load_finish() {
+    char* fs_base = (char*)FS_BASE;
+    struct FSHeaderV2* header = (struct FSHeaderV2*)fs_base;
+    uint32 meta_end;
+    uint32 fs_size;
+
+    if (ata_wait(&fs_header_request) != ATA_REQ_DONE)
+        return 0;
+
+    // 1. Where the metadata ends and how far the file contents reach
+    if (header->magic == FS_V2_MAGIC && header->version == 2) {
+        fs_version = 2;
+        fs_files = header->file_count;
+        meta_end = header->data_offset;
+        fs_size = header->total_size;
+        if ((meta_end & 0xFFF) || header->bucket_count == 0 ||
+            (header->bucket_count & (header->bucket_count - 1)))
+            return 0;
+        // Directory and hash table must lie inside the metadata that gets loaded
+        if (header->dir_offset > meta_end ||
+            fs_files > (meta_end - header->dir_offset) / sizeof(struct FileEntryV2))
+            return 0;
+        if (header->hash_offset > meta_end ||
+            header->bucket_count > (meta_end - header->hash_offset) / sizeof(uint16))
+            return 0;
+    } else if (fs_base[0] == 'F' && fs_base[1] == 'S') {
+        fs_version = 1;
+        fs_files = *(uint16*)(fs_base + 2);
+        meta_end = 4 + fs_files * sizeof(struct FileHeader);
+        fs_size = meta_end; // Extended once the table is in, below
+    } else {
+        return 0;
+    }
+
+    uint32 meta_pages = (meta_end + 4095) / 4096;
+    if (meta_pages * 4096 > FS_MAX_SECTORS * 512)
+        return 0;
+
+    // 2. The rest of the metadata, if it spills past the first page
+    if (meta_pages > 1)
+        bcache_read(FS_LBA + 8, (meta_pages - 1) * 8, fs_base + 4096);
+    fs_pages_loaded = meta_pages;
+
+    if (fs_version == 1) {
+        // File contents end at the furthest file
+        struct FileHeader* files = (struct FileHeader*)(fs_base + 4);
+        for (int i = 0; i < fs_files; i++) {
+            uint32 end = meta_end + files[i].offset + files[i].size;
+            if (end > fs_size)
+                fs_size = end;
+        }
+    }
+    if (fs_size > FS_MAX_SECTORS * 512) {
+        print("ERR: FS larger than its window, truncated\n");
+        fs_size = FS_MAX_SECTORS * 512;
+    }
+
+    // 3. Everything past the metadata stays unmapped until it is touched
+    for (uint32 addr = FS_BASE + meta_pages * 4096; addr < FS_BASE + fs_size; addr += 4096) {
+        uint32* pte = get_pte(addr);
+        *pte = (*pte & ~1) | PTE_FS_LAZY;
+        invlpg(addr);
+    }
+    return 1;
+}
+
+// Reads 'length' bytes at FS disk offset 'offset' (length <= 4KB) through the
+// block cache. Returns a pointer to them inside fs_block_buffer.
+uint8* fs_read_bytes(uint32 offset, uint32 length) {
+    uint32 first = offset / 512;
+    uint32 last = (offset + length + 511) / 512;
+    bcache_read(FS_LBA + first, last - first, fs_block_buffer);
+    return fs_block_buffer + (offset & 511);
+}
+
+// The file whose (page-rounded) contents cover FS offset 'offset', or 0
+struct FileEntryV2* fs_entry_at(uint32 offset) {
+    struct FSHeaderV2* header = (struct FSHeaderV2*)FS_BASE;
+    struct FileEntryV2* dir = (struct FileEntryV2*)((char*)FS_BASE + header->dir_offset);
+    for (int i = 0; i < fs_files; i++) {
+        if (offset >= dir[i].offset && offset < dir[i].offset + ((dir[i].size + 4095) & ~4095))
+            return &dir[i];
+    }
+    return 0;
+}
+
+// Fills the (mapped) FS page at 'frame' from disk
+void fs_fill_page(uint32 frame) {
+    struct FSHeaderV2* header = (struct FSHeaderV2*)FS_BASE;
+    uint32 offset = frame - FS_BASE;
+
+    // 1. Version 1 images and metadata have the same layout on disk and in memory
+    if (fs_version == 1 || offset < header->data_offset) {
+        bcache_read(FS_LBA + offset / 512, 8, (void*)frame);
+        return;
+    }
+
+    struct FileEntryV2* entry = fs_entry_at(offset);
+    if (!entry) {
+        // Padding between files
+        memset((void*)frame, 0, 4096);
+        return;
+    }
+
+    uint32 page = (offset - entry->offset) / 4096;
+    if (!(entry->flags & FS_FILE_LZ4)) {
+        // 2. Plain file: page aligned on disk too, the tail past the file is zero
+        bcache_read(FS_LBA + (entry->disk_offset + page * 4096) / 512, 8, (void*)frame);
+        return;
+    }
+
+    // 3. Compressed: find the page's block in the table, then decode it in place
+    uint32* table = (uint32*)fs_read_bytes(entry->disk_offset + page * 4, 8);
+    uint32 block_start = table[0];
+    uint32 block_len = table[1] - table[0];
+    uint32 plain_len = entry->size - page * 4096;
+    if (plain_len > 4096)
+        plain_len = 4096;
+
+    int decoded = -1;
+    if (block_len <= 4096) {
+        uint8* block = fs_read_bytes(entry->disk_offset + block_start, block_len);
+        if (block_len == plain_len) {
+            memcpy((void*)frame, block, block_len);
+            decoded = block_len;
+        } else {
+            decoded = lz4_decompress(block, block_len, (uint8*)frame, plain_len);
+        }
+    }
+    if (decoded != plain_len) {
+        print("ERR: Corrupt LZ4 block\n");
+        decoded = 0;
+    }
+
+    memset((uint8*)frame + decoded, 0, 4096 - decoded);
+}
+
+int fs_page_in(uint32 address) {
+    // The FS window and its aliases (the app range) all sit in the first 4MB
+    if (address >= 0x400000)
+        return 0;
+
+    uint32 page = address & 0xFFFFF000;
+    uint32* pte = get_pte(page);
+    if (!(*pte & PTE_FS_LAZY))
+        return 0;
+
+    uint32 frame = *pte & 0xFFFFF000;
+    if (frame < FS_BASE || frame >= FS_END)
+        return 0;
+
+    // 1. Load the FS page itself (identity mapped, so frame == its address)
+    uint32* fs_pte = get_pte(frame);
+    if (*fs_pte & PTE_FS_LAZY) {
+        // Map first: PIO stores through this virtual address.
+        // Nothing else runs until the fault returns, so nobody sees the page half-filled.
+        *fs_pte = (*fs_pte & ~PTE_FS_LAZY) | 3;
+        invlpg(frame);
+
+        // Interrupts are off in the fault handler; the ATA queue is polled.
+        // A sequential reader gets readahead, so the disk fetches the next
+        // blocks while this one is being decoded.
+        fs_fill_page(frame);
+        fs_pages_loaded++;
+    }
+
+    // 2. An alias keeps the protection bits its mapper chose, it only becomes present
+    if (pte != fs_pte) {
+        *pte = (*pte & ~PTE_FS_LAZY) | 1;
+        invlpg(page);
+    }
+    return 1;
+}
+
+int fs_file_count() {
+    return fs_files;
+}
+
+// FNV-1a over the name (at most 16 bytes, names need not be NUL terminated).
+// build_fs.py computes the same hash.
+uint32 fs_hash(const char* name) {
+    uint32 hash = 2166136261u;
+    for (int i = 0; i < 16 && name[i]; i++) {
+        hash ^= (uint8)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+int fs_name_equal(const char* entry_name, const char* name) {
+    for (int i = 0; i < 16; i++) {
+        if (entry_name[i] != name[i])
+            return 0;
+        if (!name[i])
+            return 1;
+    }
+    return name[16] == 0;
+}
+
+int fs_get(int index, struct FSFile* out) {
+    char* fs_base = (char*)FS_BASE;
+    if (index < 0 || index >= fs_files)
+        return 0;
+
+    const char* name;
+    if (fs_version == 2) {
+        struct FSHeaderV2* header = (struct FSHeaderV2*)fs_base;
+        struct FileEntryV2* entry = (struct FileEntryV2*)(fs_base + header->dir_offset) + index;
+        name = entry->name;
+        out->index = index;
+        out->size = entry->size;
+        out->data = fs_base + entry->offset;
+        out->flags = entry->flags;
+        out->checksum = entry->checksum;
+    } else {
+        struct FileHeader* entry = (struct FileHeader*)(fs_base + 4) + index;
+        name = entry->name;
+        out->index = index;
+        out->size = entry->size;
+        out->data = fs_base + 4 + fs_files * sizeof(struct FileHeader) + entry->offset;
+        out->flags = FS_FILE_EXEC; // Version 1 has no flags; everything was runnable
+        out->checksum = 0;
+    }
+
+    memcpy(out->name, name, 16);
+    out->name[16] = 0;
+    return 1;
+}
+
+int fs_find(const char* name, struct FSFile* out) {
+    char* fs_base = (char*)FS_BASE;
+
+    if (fs_version == 2) {
+        // Hash bucket, then its chain
+        struct FSHeaderV2* header = (struct FSHeaderV2*)fs_base;
+        struct FileEntryV2* dir = (struct FileEntryV2*)(fs_base + header->dir_offset);
+        uint16* buckets = (uint16*)(fs_base + header->hash_offset);
+
+        uint16 index = buckets[fs_hash(name) & (header->bucket_count - 1)];
+        while (index != FS_NO_ENTRY && index < fs_files) {
+            if (fs_name_equal(dir[index].name, name))
+                return fs_get(index, out);
+            index = dir[index].next;
+        }
+        return 0;
+    }
+
+    struct FileHeader* files = (struct FileHeader*)(fs_base + 4);
+    for (int i = 0; i < fs_files; i++) {
+        if (fs_name_equal(files[i].name, name))
+            return fs_get(i, out);
+    }
+    return 0;
+}
+
+// CRC32 (IEEE, reflected), bit at a time: only run once per file load
+uint32 crc32(const uint8* data, uint32 length) {
+    uint32 crc = 0xFFFFFFFF;
+    for (uint32 i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+int fs_verify(struct FSFile* file) {
+    if (!(file->flags & FS_FILE_CHECKSUM))
+        return 1;
+
+    // Only version 2 files carry a checksum
+    struct FSHeaderV2* header = (struct FSHeaderV2*)FS_BASE;
+    struct FileEntryV2* entry = (struct FileEntryV2*)((char*)FS_BASE + header->dir_offset) + file->index;
+    if (entry->verified)
+        return 1;
+
+    if (crc32((const uint8*)file->data, file->size) != file->checksum)
+        return 0;
+    entry->verified = 1;
+    return 1;
+}
@@ -0,0 +1,95 @@
+#ifndef FS_H
+#define FS_H
+// fs.h
+
+#include "kernel.h"
+
+// The FS image sits on disk right after the kernel (see build_fs.py) and is
+// mapped 1:1 at FS_BASE. Only the header and file table are read at boot;
+// every other page is read from disk the first time it is touched.
+#define FS_BASE        0x200000
+#define FS_LBA         128
+#define FS_MAX_SECTORS 2500 // Size of the window reserved at FS_BASE
+#define FS_END         (FS_BASE + FS_MAX_SECTORS * 512)
+
+// PTE available bit: page belongs to the FS and has not been read yet
+#define PTE_FS_LAZY    0x200
+
+// --- VERSION 2 IMAGE ---
+// "FS2\0" header, then the directory, then the hash buckets. File data
+// starts at 'data_offset' and every file is 4KB aligned, so a file can be
+// mapped page by page instead of copied. All offsets are from the FS start.
+// Version 1 images ('FS' + uint16 count + struct FileHeader[]) still load.
+//
+// Metadata sits at the same offsets on disk and in memory. File contents
+// are stored at 'disk_offset' (also page aligned); for FS_FILE_LZ4 files
+// that is a block table, uint32[pages + 1] of offsets from 'disk_offset',
+// followed by one LZ4 block per 4KB page. A block as long as its page is
+// stored uncompressed.
+#define FS_V2_MAGIC    0x00325346 // "FS2\0"
+#define FS_NO_ENTRY    0xFFFF     // End of a hash chain / empty bucket
+
+// Per-file flags
+#define FS_FILE_EXEC      0x01 // Can be run with run_app
+#define FS_FILE_READONLY  0x02 // Guest must not modify it (mapped read-only, no copy on write)
+#define FS_FILE_CHECKSUM  0x04 // Verify against 'checksum' before use (build_fs.py --checksum)
+#define FS_FILE_LZ4       0x08 // Stored compressed, decoded page by page when touched
+
+struct FSHeaderV2 {
+    uint32 magic;
+    uint16 version;
+    uint16 file_count;
+    uint32 bucket_count;   // Power of two
+    uint32 dir_offset;     // struct FileEntryV2[file_count]
+    uint32 hash_offset;    // uint16[bucket_count]: first entry of each chain
+    uint32 data_offset;    // First file, 4KB aligned; everything before it is metadata
+    uint32 total_size;     // In memory; compressed files make the disk image smaller
+} __attribute__((packed));
+
+struct FileEntryV2 {
+    char name[16];
+    uint32 size;
+    uint32 offset;         // 4KB aligned
+    uint32 flags;          // FS_FILE_*
+    uint32 checksum;       // CRC32 (IEEE) of the contents
+    uint16 next;           // Next entry in the same bucket, or FS_NO_ENTRY
+    uint16 verified;       // 0 on disk; set in memory once the CRC matched
+    uint32 disk_offset;    // Where the contents are stored on disk
+} __attribute__((packed));
+
+// A file of either image version, as the rest of the kernel sees it
+struct FSFile {
+    int index;             // Directory index
+    char name[17];         // NUL terminated
+    uint32 size;
+    char* data;            // Inside the FS window
+    uint32 flags;
+    uint32 checksum;
+};
+
+// Starts reading the first FS page; paging may be set up while it is in flight
+void fs_load_start();
+
+// Waits for the header, reads the rest of the metadata and leaves the file
+// contents unmapped. Needs paging on. Returns 0 if there is no valid FS.
+int fs_load_finish();
+
+// Page fault hook: reads the FS page at 'address' if it is still lazy.
+// 'address' may also be an alias of an FS page (app mapping), whose PTE
+// points at the FS frame and carries PTE_FS_LAZY until that frame is loaded.
+// Returns 1 if the fault was handled.
+int fs_page_in(uint32 address);
+
+int fs_file_count();
+
+// Fill 'out' and return 1, or return 0 if there is no such file
+int fs_get(int index, struct FSFile* out);
+int fs_find(const char* name, struct FSFile* out);
+
+// Returns 0 if the file carries a checksum and its contents do not match it.
+// The check runs once per boot; later loads share the verified pages. It
+// touches every page of the file, so FS_FILE_CHECKSUM is opt-in.
+int fs_verify(struct FSFile* file);
+
+uint32 crc32(const uint8* data, uint32 length);
+#endif
@@ -2,6 +2,8 @@
 #define HOOK_H
 // hooks.h
 
+#include "kernel.h"
+
 // Hook Callback Function Pointer
 // address: The virtual address accessed
 // page_ptr: Pointer to the actual physical memory page (4KB buffer)
@@ -9,14 +11,154 @@
 // Return: 1 to handled, 0 to crash
 typedef int (*HookCallback)(uint32 address, void* page_ptr, int is_write);
 
+// --- REGISTER-GRANULAR HOOKS ---
+// Instead of one callback for the whole page, a page can carry a register map.
+// The fault path resolves the touched register with a single table lookup and
+// calls only that register's handler with the exact address, width and value.
+struct MMIORegister;
+
+// Returns the current register contents; the kernel hands the CPU the bytes it accessed.
+// width: access width in bytes (1, 2 or 4)
+typedef uint32 (*MMIOReadHandler)(struct MMIORegister* reg, uint32 address, int width);
+
+// Called after the CPU stored into the register. 'value' is the whole register
+// with the stored bytes merged in.
+// The handler decides what ends up in reg->value (e.g. write-1-to-clear bits).
+typedef void (*MMIOWriteHandler)(struct MMIORegister* reg, uint32 address, uint32 value, int width);
+
+// Polling support for status registers. Called when the guest is spinning on
+// the register; returns how many ticks from now its value will change
+// (0 = unknown). The kernel then jumps time forward and reads it again.
+typedef uint32 (*MMIOPollHandler)(struct MMIORegister* reg, uint32 address);
+
+struct MMIORegister {
+    uint16 offset;          // Offset inside the page (aligned to 'width')
+    uint16 width;           // Register width in bytes (1, 2 or 4)
+    MMIOReadHandler read;   // 0 = reads return 'value'
+    MMIOWriteHandler write; // 0 = writes are latched into 'value'
+    uint32 reset_value;     // Loaded into 'value' when the map is registered
+    uint32 value;           // Current register contents
+    MMIOPollHandler poll;   // 0 = never fast-forward
+    uint32 flags;           // MMIO_REG_* (trailing fields may be omitted in maps)
+};
+
+// Register flags
+#define MMIO_REG_DEFERRED 1 // Write handler runs later from the write queue, not in the fault.
+                            // For write-only data registers (USART DR, SPI DR) whose side
+                            // effect the guest does not wait for.
+                            // The value is already latched when the handler runs, and
+                            // the handler must not write reg->value: with a peripheral
+                            // core (smp.h) it runs there, concurrently with the guest
+                            // reading the register. It may klog; register changes
+                            // (set_mmio_register) and anything else go to the guest
+                            // core with smp_call_guest().
+
+// --- DEFERRED WRITE QUEUE ---
+// Ring of writes whose handlers run later. Entries are only published by
+// moving 'head' and only retired by moving 'tail'.
+//
+// Producers: write_register, reached from the page fault / debug trap and
+// from device requests (ioring). Consumers: drain_write_queue, from the
+// timer interrupt, the idle loop (under cli) and queue_write itself when
+// the ring is full. All of these run on the boot CPU with interrupts off,
+// so no two of them ever overlap; that, not a lock, is what keeps the ring
+// consistent. Any new caller must hold interrupts off as well.
+// With a peripheral core (smp.h) it becomes the only consumer and the boot
+// CPU only produces.
+#define WRITE_QUEUE_SIZE 256 // Must be a power of two
+
+struct HookEntry;
+
+struct QueuedWrite {
+    struct HookEntry* hook; // Page the register lives on (shadow resync)
+    struct MMIORegister* reg;
+    uint32 address;
+    uint32 value;
+    uint32 timestamp;       // tick_counter when the guest wrote
+};
+
+// Runs the write handlers of all queued writes, oldest first. Consumer
+// side: the peripheral core, or the boot CPU if there is none.
+void drain_write_queue();
+int write_queue_pending();
+
+// Peripheral core exception: if it hit inside a write handler, logs that
+// write and retires it, so the guest core does not run the handler again
+void write_queue_drop_running();
+
+// Spin-wait detection: this many back-to-back reads of one register from one
+// EIP, with no hooked write in between, count as a polling loop.
+#define POLL_THRESHOLD 4
+
+#define MAX_REGS_PER_PAGE 255
+
+// How the hooked page is mapped
+#define HOOK_MODE_TRAP   0 // Not Present: every read and write faults
+#define HOOK_MODE_SHADOW 1 // Present + Read-Only: the page holds the current register
+                           // values, so reads run at memory speed and only writes fault
+
+// --- PER-HOOK LATENCY STATS ---
+// Cycle counts (rdtsc) of each trapped access, split into three spans and
+// kept as log2 histograms: bucket n counts samples in [2^n, 2^(n+1)).
+#define HOOK_HIST_BUCKETS 32
+
+struct HookStats {
+    uint32 entry_to_callback[HOOK_HIST_BUCKETS]; // Fault entry -> first device callback
+    uint32 callback[HOOK_HIST_BUCKETS];          // Time inside device callbacks
+    uint32 callback_to_exit[HOOK_HIST_BUCKETS];  // Last callback -> return to the guest
+};
+
 struct HookEntry {
     uint32 virtual_address; // The address to hook (Must be 4KB aligned)
-    HookCallback callback;  // The function to call
+    HookCallback callback;  // The function to call (page-granular hooks)
+    struct MMIORegister* regs; // Register map (register-granular hooks), 0 if unused
+    uint8* reg_index;       // 1024 entries: (offset >> 2) -> register number + 1, 0 = none
+    int mode;               // HOOK_MODE_*
+    void* page_ptr;         // Physical frame backing the hooked page
+    uint32* pte;            // Page table entry mapping 'virtual_address'
+    struct HookStats* stats; // Latency histograms, cleared on registration
     int active;             // Is this hook used?
 };
 
 // Global State
-#define MAX_HOOKS 10
-struct HookEntry hooks[MAX_HOOKS];
-struct HookEntry* current_pending_write_hook = 0; // Context for the Debug Handler
-#endif
\ No newline at end of file
+#define MAX_HOOKS 512
+
+// register_hook / unregister_hook results
+#define HOOK_OK             0
+#define HOOK_ERR_FULL      -1 // All MAX_HOOKS slots are in use
+#define HOOK_ERR_NO_MEMORY -2 // Kernel heap exhausted (dispatch leaf or page table)
+#define HOOK_ERR_EXISTS    -3 // Page is already hooked
+#define HOOK_ERR_NOT_FOUND -4 // Page is not hooked
+#define HOOK_ERR_INVALID   -5 // Malformed register map (bad width/offset, two registers in one word)
+
+int register_hook(uint32 address, HookCallback cb);
+int register_mmio_hook(uint32 address, struct MMIORegister* regs, int count);
+
+// Like register_mmio_hook, but in HOOK_MODE_SHADOW. Read handlers are never
+// called; models publish state changes with set_mmio_register instead.
+int register_shadow_hook(uint32 address, struct MMIORegister* regs, int count);
+
+// Sets the value of the register at 'address' from the device model side
+// (e.g. a status bit flipping). Keeps shadow pages in sync.
+int set_mmio_register(uint32 address, uint32 value);
+int unregister_hook(uint32 address);
+struct HookEntry* find_hook(uint32 address);
+
+// Copies the stats of the hook at 'address' to 'out' (if not 0) and optionally clears them
+int get_hook_stats(uint32 address, struct HookStats* out, int reset);
+
+// Device-side access to a hooked page that does not touch its mapping.
+// Credited to the faulting instruction (active_eip). An access that covers
+// more than one register, or a register and a gap, is split so each
+// register's handlers only see its own bytes.
+uint32 hook_read(struct HookEntry* hook, uint32 address, int width);
+void hook_write(struct HookEntry* hook, uint32 address, int width, uint32 value);
+
+// The same for accesses submitted through the request ring (ioring.c).
+// No guest instruction is behind them: they are traced with eip
+// HOOK_RING_EIP, and reads never count towards polling detection (a write
+// still ends a spin, like any write).
+#define HOOK_RING_EIP 0
+uint32 hook_ring_read(struct HookEntry* hook, uint32 address, int width);
+void hook_ring_write(struct HookEntry* hook, uint32 address, int width, uint32 value);
+#endif
@@ -7,17 +7,29 @@ section .text
 [extern timer_handler]
 [extern syscall_handler]
 [extern keyboard_handler]
+[extern ata_irq_handler]
+[extern serial_irq_handler]
+[extern smp_ipi_handler]
+[extern ap_fault_handler]
 global isr1_wrapper
 global isr14_wrapper
 global isr_timer_wrapper
 global isr_keyboard_wrapper
+global isr_ata_wrapper
+global isr_serial_wrapper
+global isr_lapic_timer_wrapper
+global isr_spurious
+global isr_smp_ipi_wrapper
+global ap_fault_stubs
 global isr80
+global sysenter_entry
 global load_idt
 
 
 isr1_wrapper:
     push 0          ; Dummy error code (Int 1 doesn't push one, but struct expects it)
     pusha           ; Pushes EDI, ESI, EBP, ESP, EBX, EDX, ECX, EAX
+    cld             ; The guest may trap with DF set; memcpy and friends need it clear
 
     push esp        ; Pass pointer to TrapFrame as argument
     call debug_handler
@@ -30,6 +42,7 @@ isr1_wrapper:
 isr14_wrapper:
     ; Int 14 pushes error code automatically.
     pusha
+    cld
 
     push esp        ; Pass pointer to TrapFrame
     call page_fault_handler
@@ -63,6 +76,64 @@ isr_timer_wrapper:
     popad               ; Restore registers
     iretd               ; Return from Interrupt
 
+; Local APIC timer (one-shot / TSC deadline), see timer.c
+isr_lapic_timer_wrapper:
+    pushad
+    cld
+
+    call timer_handler
+
+    ; EOI goes to the local APIC (LAPIC_BASE + LAPIC_EOI), not the PIC
+    mov dword [0xFEE000B0], 0
+
+    popad
+    iretd
+
+; Wake-up IPI between the guest core and the peripheral core (smp.c).
+; Each CPU's EOI reaches its own LAPIC through the same address.
+isr_smp_ipi_wrapper:
+    pushad
+    cld
+
+    call smp_ipi_handler
+
+    mov dword [0xFEE000B0], 0
+
+    popad
+    iretd
+
+; Spurious LAPIC interrupts take no EOI
+isr_spurious:
+    iretd
+
+; Exceptions 0-31 on the peripheral core (smp.c). One 16 byte stub per
+; vector, so vector n enters at ap_fault_stubs + 16 * n. Each builds a
+; TrapFrame (dummy error code where the CPU pushes none) and the vector.
+align 16
+ap_fault_stubs:
+%assign vec 0
+%rep 32
+    align 16
+%if !(vec == 8 || (vec >= 10 && vec <= 14) || vec == 17 || vec == 21 || vec == 29 || vec == 30)
+    push 0          ; Dummy error code
+%endif
+    pushad
+    push vec
+    jmp ap_fault_common
+%assign vec vec + 1
+%endrep
+
+ap_fault_common:
+    cld
+    lea eax, [esp + 4]   ; TrapFrame
+    push eax
+    push dword [esp + 4] ; Vector
+    call ap_fault_handler ; Does not return
+.halt:
+    cli
+    hlt
+    jmp .halt
+
 isr_keyboard_wrapper:
     pushad
     cld
@@ -74,9 +145,34 @@ isr_keyboard_wrapper:
     popad
     iretd
 
+isr_ata_wrapper:
+    pushad
+    cld
+
+    call ata_irq_handler
+
+    ; IRQ14 comes through the slave PIC: EOI both
+    mov al, 0x20
+    out 0xA0, al
+    out 0x20, al
+    popad
+    iretd
+
+isr_serial_wrapper:
+    pushad
+    cld
+
+    call serial_irq_handler
+
+    mov al, 0x20
+    out 0x20, al
+    popad
+    iretd
+
 isr80:
     cli             ; Disable interrupts
     pusha           ; Save all registers (EDI, ESI, EBP, ESP, EBX, EDX, ECX, EAX)
+    cld
     push ds
     push es
     push fs
@@ -98,3 +194,22 @@ isr80:
     pop ds
     popa            ; Restore registers (EAX contains return value if you modify it)
     iret
+
+; SYSENTER fast path (see syscall/syscalls.h for the guest side).
+; The CPU put us on the syscall stack (IA32_SYSENTER_ESP) with interrupts off.
+; The guest runs in ring 0, so there is no SYSEXIT: the stub leaves its
+; stack pointer in EBP with its return address on top, and we go back with
+; a plain ret. The stub restores EFLAGS (and with it IF) itself.
+sysenter_entry:
+    sub esp, 12     ; eip, cs, eflags slots of registers_t (unused here)
+    pusha
+    cld
+    sub esp, 16     ; gs, fs, es, ds slots: segments are flat, nothing to reload
+
+    push esp
+    call syscall_handler
+    add esp, 4 + 16
+
+    popa            ; EAX now holds the result, EBP the guest stack
+    mov esp, ebp
+    ret
@@ -0,0 +1,102 @@
+// ioring.c
+#include "ioring.h"
+#include "print.h"
+#include "serial.h"
+#include "hook.h"
+#include "mem.h"
+
+#define ring ((struct IORing*)IORING_ADDR)
+
+void ioring_reset() {
+    memset(ring, 0, 4096);
+    ring->magic = IORING_MAGIC;
+}
+
+int ioring_pending() {
+    return ring->sq_head != ring->sq_tail;
+}
+
+static int valid_width(uint32 width) {
+    return width == 1 || width == 2 || width == 4;
+}
+
+// Runs one request. Returns IORING_OK or IORING_ERR_*; device reads leave
+// the register contents in 'value'.
+static int ioring_dispatch(struct IORingRequest* req, uint32* value) {
+    struct HookEntry* hook;
+
+    switch (req->opcode) {
+    case IORING_OP_NOP:
+        return IORING_OK;
+    case IORING_OP_PRINT:
+        print((char*)req->args[0]);
+        return IORING_OK;
+    case IORING_OP_PRINT_HEX:
+        print_hex(req->args[0]);
+        return IORING_OK;
+    case IORING_OP_LOG:
+        serial_write((const void*)req->args[0], req->args[1]);
+        return IORING_OK;
+    case IORING_OP_REGISTER_TIMER:
+        register_timer_handler((TimerCallback)req->args[0]);
+        return IORING_OK;
+    case IORING_OP_DEVICE_READ:
+    case IORING_OP_DEVICE_WRITE:
+        // Same limits as a trapped access: 1, 2 or 4 bytes inside the page
+        if (!valid_width(req->args[1]) || (req->args[0] & 0xFFF) + req->args[1] > 4096)
+            return IORING_ERR_INVALID;
+        hook = find_hook(req->args[0]);
+        if (!hook)
+            return IORING_ERR_NOT_FOUND;
+        // Same handlers and write queue as a trapped access
+        if (req->opcode == IORING_OP_DEVICE_READ)
+            *value = hook_ring_read(hook, req->args[0], req->args[1]);
+        else
+            hook_ring_write(hook, req->args[0], req->args[1], req->args[2]);
+        return IORING_OK;
+    }
+    return IORING_ERR_INVALID;
+}
+
+uint32 ioring_process() {
+    uint32 handled = 0;
+    uint32 head = ring->sq_head;
+    uint32 tail = ring->sq_tail;
+
+    // Entries up to 'tail' were filled before the guest moved it
+    asm volatile("" ::: "memory");
+
+    while (head != tail) {
+        struct IORingRequest* req = &ring->sq[head & (IORING_SQ_ENTRIES - 1)];
+        int silent = req->flags & IORING_SQE_SILENT;
+
+        // No room for the result: leave the rest for when the guest has reaped
+        if (!silent && ring->cq_tail - ring->cq_head >= IORING_CQ_ENTRIES)
+            break;
+
+        uint32 value = 0;
+        int status = ioring_dispatch(req, &value);
+
+        if (!silent) {
+            struct IORingCompletion* cqe = &ring->cq[ring->cq_tail & (IORING_CQ_ENTRIES - 1)];
+            cqe->user_data = req->user_data;
+            cqe->status = status;
+            cqe->value = value;
+            asm volatile("" ::: "memory");
+            ring->cq_tail++;
+        }
+
+        // The slot goes back to the guest only now that it has been read
+        head++;
+        ring->sq_head = head;
+        handled++;
+    }
+
+    ring->processed += handled;
+    return handled;
+}
+
+uint32 ioring_doorbell() {
+    ring->doorbells++;
+    return ioring_process();
+}
@@ -0,0 +1,80 @@
+#ifndef IORING_H
+#define IORING_H
+// ioring.h
+
+#include "kernel.h"
+
+// --- SHARED SUBMISSION / COMPLETION RINGS ---
+// A page the guest app and the kernel both use. The guest fills submission
+// entries (print, log, timer registration, device accesses) and publishes
+// them by moving sq_tail; nothing traps. The kernel works through the batch
+// when the guest rings the doorbell (SYSCALL_RING_ENTER) and, for entries
+// queued without one, from the next timer interrupt.
+//
+// Each ring has one producer and one consumer and is indexed with free
+// running counters masked by the ring size:
+//   SQ: guest produces (sq_tail), kernel consumes (sq_head)
+//   CQ: kernel produces (cq_tail), guest consumes (cq_head)
+// The guest layout is repeated in syscall/syscalls.h; keep both in sync.
+#define IORING_ADDR       0x1F3000   // Identity-mapped page between the vDSO and the timer device
+#define IORING_MAGIC      0x474E4952 // "RING"
+#define IORING_SQ_ENTRIES 128        // Must be a power of two
+#define IORING_CQ_ENTRIES 64         // Must be a power of two
+
+// Opcodes
+#define IORING_OP_NOP            0
+#define IORING_OP_PRINT          1 // args[0] = NUL terminated string, valid until processed
+#define IORING_OP_PRINT_HEX      2 // args[0] = value
+#define IORING_OP_LOG            3 // args[0] = bytes, args[1] = length: raw to COM1
+#define IORING_OP_REGISTER_TIMER 4 // args[0] = TimerCallback
+#define IORING_OP_DEVICE_READ    5 // args[0] = hooked address, args[1] = width; value in the completion
+#define IORING_OP_DEVICE_WRITE   6 // args[0] = hooked address, args[1] = width, args[2] = value
+
+// Submission flags
+#define IORING_SQE_SILENT 1 // Post no completion (fire and forget)
+
+// Completion status
+#define IORING_OK               0
+#define IORING_ERR_INVALID     -1 // Unknown opcode or bad width
+#define IORING_ERR_NOT_FOUND   -2 // Device address is not hooked
+
+struct IORingRequest {
+    uint16 opcode;    // IORING_OP_*
+    uint16 flags;     // IORING_SQE_*
+    uint32 user_data; // Handed back in the completion
+    uint32 args[3];
+};
+
+struct IORingCompletion {
+    uint32 user_data;
+    int status;       // IORING_OK or IORING_ERR_*
+    uint32 value;     // Result (device reads)
+};
+
+struct IORing {
+    uint32 magic;
+    volatile uint32 sq_head;  // Next entry the kernel processes
+    volatile uint32 sq_tail;  // Next free entry (guest)
+    volatile uint32 cq_head;  // Next completion the guest reaps
+    volatile uint32 cq_tail;  // Next free completion (kernel)
+    uint32 processed;         // Requests handled since the ring was reset
+    uint32 doorbells;         // SYSCALL_RING_ENTER count
+    uint32 reserved[9];
+    struct IORingRequest sq[IORING_SQ_ENTRIES];
+    struct IORingCompletion cq[IORING_CQ_ENTRIES];
+};
+
+// Clears the page and writes the header. Boot, and again before each app
+void ioring_reset();
+
+// Handles every published request the completion ring has room for.
+// Runs with interrupts off (doorbell, timer interrupt). Returns how many
+// requests were handled.
+uint32 ioring_process();
+
+// SYSCALL_RING_ENTER: counts the doorbell, then ioring_process()
+uint32 ioring_doorbell();
+
+// 1 if the guest has queued requests the kernel has not handled yet
+int ioring_pending();
+#endif
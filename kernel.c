@@ -6,6 +6,21 @@
 #include "ata.h"
 #include "ports.h"
 #include "acpi.h"
+#include "emulate.h"
+#include "serial.h"
+#include "trace.h"
+#include "bench.h"
+#include "fs.h"
+#include "mem.h"
+#include "console.h"
+#include "klog.h"
+#include "vclock.h"
+#include "timer.h"
+#include "syscalls.h"
+#include "ioring.h"
+#include "vdso.h"
+#include "smp.h"
+#include "vtimer.h"
 
 // These functions are defined in interrupts.asm
 extern void isr1_wrapper(void);
@@ -13,6 +28,11 @@ extern void isr14_wrapper(void);
 extern void isr80(void);
 extern void isr_timer_wrapper(void);
 extern void isr_keyboard_wrapper(void);
+extern void isr_ata_wrapper(void);
+extern void isr_serial_wrapper(void);
+extern void isr_lapic_timer_wrapper(void);
+extern void isr_spurious(void);
+extern void isr_smp_ipi_wrapper(void);
 extern void load_idt(void* base, unsigned short size);
 
 uint32 page_directory[1024] __attribute__((aligned(4096)));
@@ -22,14 +42,18 @@ uint32 first_page_table[1024] __attribute__((aligned(4096)));
 struct IDTEntry idt[256];
 
 TimerCallback user_timer_callback = 0;
-uint32 tick_counter = 0;
 
+void set_idt_gate(struct IDTEntry* table, int n, unsigned int handler) {
+    table[n].offset_low = handler & 0xFFFF;       // Lower 16 bits of address
+    table[n].selector = 0x08;                     // Kernel Code Segment (Offset in GDT)
+    table[n].zero = 0;                            // Always zero
+    table[n].type_attr = 0x8E;                    // 10001110b (Present, Ring 0, 32-bit Interrupt Gate)
+    table[n].offset_high = (handler >> 16) & 0xFFFF; // Upper 16 bits of address
+}
+
+// Boot CPU's IDT
 void setup_idt_entry(int n, unsigned int handler) {
-    idt[n].offset_low = handler & 0xFFFF;       // Lower 16 bits of address
-    idt[n].selector = 0x08;                     // Kernel Code Segment (Offset in GDT)
-    idt[n].zero = 0;                            // Always zero
-    idt[n].type_attr = 0x8E;                    // 10001110b (Present, Ring 0, 32-bit Interrupt Gate)
-    idt[n].offset_high = (handler >> 16) & 0xFFFF; // Upper 16 bits of address
+    set_idt_gate(idt, n, handler);
 }
 
 void remap_pic() {
@@ -54,99 +78,648 @@ void remap_pic() {
     outb(0xA1, a2);
 }
 
-// 2. Initialize PIT for 50us (20kHz)
-// Base Frequency: 1193182 Hz
-// Divisor = 1193182 / 20000 = ~59
-void init_pit_50us() {
-    uint32 frequency = 20000;
-    uint32 divisor = 1193180 / frequency;
-
-    // Command: Channel 0, Access lo/hi byte, Square Wave, 16-bit binary
-    outb(0x43, 0x36);
-
-    // Split divisor into bytes
-    uint8 l = (uint8)(divisor & 0xFF);
-    uint8 h = (uint8)( (divisor>>8) & 0xFF );
-
-    // Send Frequency
-    outb(0x40, l);
-    outb(0x40, h);
-}
-
 // This is executed by system call
 void register_timer_handler(TimerCallback cb) {
     user_timer_callback = cb;
-    print("Timer Handler Registered!\n");
+    klog(KLOG_TIMER_REGISTERED, (uint32)cb, 0, 0);
+    timer_kick(1); // The one-shot timer may be armed far out
 }
 
 void timer_handler() {
-    tick_counter++;
-    if (user_timer_callback) 
-        user_timer_callback();
+    // One tick on the PIT; on the LAPIC, however many passed since the last interrupt
+    uint32 ticks = timer_elapsed_ticks();
+    if (ticks) {
+        advance_ticks(ticks);
+        // Deferred model work, unless the peripheral core does it
+        smp_peripheral_work();
+        smp_run_guest_calls();
+        // Requests the guest queued without ringing the doorbell
+        if (ioring_pending())
+            ioring_process();
+        if (user_timer_callback)
+            user_timer_callback();
+        // Guests that never return to the idle loop still see their output
+        // and get their accesses traced
+        console_tick();
+        trace_tick();
+    }
+    timer_arm(timer_next_work());
 }
 
 void keyboard_handler() {
     uint8 scancode = inb(0x60); // Read from PS/2 Data Port
-    print("Key Pressed: ");
-    print_hex(scancode);
-    print("\n");
+    klog(KLOG_KEY_PRESSED, scancode, 0, 0);
     if (scancode == 0x1E)
         acpi_shutdown();
 }
 
+// --- KERNEL HEAP ---
+uint32 next_free_page = KERNEL_HEAP_START;
+
+// Hands out 'count' contiguous zeroed 4KB pages. Pages are never freed.
+// Returns 0 when the heap is exhausted.
+void* alloc_pages(int count) {
+    if (next_free_page + count * 4096 > KERNEL_HEAP_END)
+        return 0;
+
+    void* pages = (void*)next_free_page;
+    next_free_page += count * 4096;
+
+    memset(pages, 0, count * 4096);
+    return pages;
+}
+
+void* alloc_page() {
+    return alloc_pages(1);
+}
+
+// Small per-hook tables are carved out of a shared heap page (16-byte aligned).
+// Like pages, they are never freed; they stay with the HookEntry slot instead.
+uint8* small_pool = 0;
+uint32 small_pool_left = 0;
+
+void* alloc_small(uint32 size) {
+    size = (size + 15) & ~15;
+    if (size > small_pool_left) {
+        small_pool = (uint8*)alloc_page();
+        if (!small_pool)
+            return 0;
+        small_pool_left = 4096;
+    }
+
+    void* p = small_pool;
+    small_pool += size;
+    small_pool_left -= size;
+    return p;
+}
+
+// Returns the PTE that maps 'address'.
+// Page tables for directory entries other than the first 4MB are allocated on demand.
+uint32* get_pte(uint32 address) {
+    uint32 pd_idx = address >> 22;
+
+    if (!(page_directory[pd_idx] & 1)) {
+        uint32* table = (uint32*)alloc_page();
+        if (!table)
+            return 0;
+        page_directory[pd_idx] = ((uint32)table) | 3;
+    }
+
+    uint32* table = (uint32*)(page_directory[pd_idx] & 0xFFFFF000);
+    return &table[(address >> 12) & 0x3FF];
+}
+
 struct HookEntry hooks[MAX_HOOKS];
 struct HookEntry* active_write_hook = 0; // Remembers which hook triggered the Trap
 
-void register_hook(uint32 address, HookCallback cb) {
+// Context of the trapped access, consumed by the Debug Trap
+uint32 active_eip = 0;                  // Instruction that faulted
+uint32 active_address = 0;              // Exact faulting address (CR2)
+int active_is_write = 0;                // Fault was a write
+struct MMIORegister* active_reg = 0;    // Register touched (register-granular hooks)
+uint32 active_value = 0;                // Value we placed in the register before the step
+
+// Two-level dispatch table keyed by page number, mirroring the page tables:
+// hook_directory[address >> 22] points to a leaf page of 1024 HookEntry pointers,
+// indexed by (address >> 12) & 0x3FF. Leaves are allocated on first use.
+struct HookEntry** hook_directory[1024];
+
+int register_hook(uint32 address, HookCallback cb) {
+    // We only hook aligned pages, so mask offset
+    address &= 0xFFFFF000;
+    if (find_hook(address))
+        return HOOK_ERR_EXISTS;
+
     // 1. Find empty slot
-    for(int i=0; i<MAX_HOOKS; i++) {
+    struct HookEntry* hook = 0;
+    for (int i = 0; i < MAX_HOOKS; i++) {
         if (!hooks[i].active) {
-            hooks[i].virtual_address = address;
-            hooks[i].callback = cb;
-            hooks[i].active = 1;
+            hook = &hooks[i];
+            break;
+        }
+    }
+    if (!hook) {
+        print("ERR: Hook table full\n");
+        return HOOK_ERR_FULL;
+    }
 
-            // 2. Unmap the page immediately to activate the trap
-            int pte_idx = address / 4096;
-            // Mark Not Present (Clear Bit 0)
-            first_page_table[pte_idx] &= ~1;
-            asm volatile("mov %cr3, %eax; mov %eax, %cr3"); // Flush TLB
+    // 2. Make sure the dispatch leaf and the page table exist
+    struct HookEntry** leaf = hook_directory[address >> 22];
+    if (!leaf) {
+        leaf = (struct HookEntry**)alloc_page();
+        if (!leaf) {
+            print("ERR: Out of memory for hook\n");
+            return HOOK_ERR_NO_MEMORY;
+        }
+        hook_directory[address >> 22] = leaf;
+    }
 
-            return;
+    uint32* pte = get_pte(address);
+    if (!pte) {
+        print("ERR: Out of memory for hook\n");
+        return HOOK_ERR_NO_MEMORY;
+    }
+
+    // 3. Latency stats stay with the slot and are reused by later hooks
+    if (!hook->stats) {
+        hook->stats = (struct HookStats*)alloc_small(sizeof(struct HookStats));
+        if (!hook->stats) {
+            print("ERR: Out of memory for hook\n");
+            return HOOK_ERR_NO_MEMORY;
+        }
+    }
+    memset(hook->stats, 0, sizeof(struct HookStats));
+
+    // 4. Give the page a private frame from the kernel heap.
+    // The heap is identity mapped, so the kernel can reach the page contents
+    // through 'page_ptr' while the hooked mapping is Not Present.
+    uint32 frame = *pte & 0xFFFFF000;
+    if (!frame || frame == address) {
+        uint32* private_frame = (uint32*)alloc_page();
+        if (!private_frame) {
+            print("ERR: Out of memory for hook\n");
+            return HOOK_ERR_NO_MEMORY;
         }
+        // Identity-mapped pages keep their current contents
+        if (frame)
+            memcpy(private_frame, (void*)address, 4096);
+        frame = (uint32)private_frame;
     }
+
+    // 5. Fill in the slot and publish it to the dispatch leaf
+    hook->virtual_address = address;
+    hook->callback = cb;
+    hook->regs = 0;
+    hook->mode = HOOK_MODE_TRAP;
+    hook->page_ptr = (void*)frame;
+    hook->pte = pte;
+    hook->active = 1;
+    leaf[(address >> 12) & 0x3FF] = hook;
+    vdso_hook_slot(hook, address);
+
+    // 6. Unmap the page immediately to activate the trap
+    // Mark Not Present (Clear Bit 0), keep it writable for when we map it back
+    *pte = frame | 2;
+    invlpg(address); // Flush TLB
+
+    return HOOK_OK;
+}
+
+int unregister_hook(uint32 address) {
+    address &= 0xFFFFF000;
+    struct HookEntry* hook = find_hook(address);
+    if (!hook)
+        return HOOK_ERR_NOT_FOUND;
+
+    // Leave the page behind as plain memory holding its last contents
+    *hook->pte |= 3;
+    invlpg(address);
+
+    hook_directory[address >> 22][(address >> 12) & 0x3FF] = 0;
+    if (active_write_hook == hook)
+        active_write_hook = 0;
+    hook->active = 0;
+    vdso_hook_slot(hook, 0);
+
+    return HOOK_OK;
 }
 
 struct HookEntry* find_hook(uint32 address) {
-    // We only hook aligned pages, so mask offset
-    uint32 aligned_addr = address & 0xFFFFF000;
-    for(int i=0; i<MAX_HOOKS; i++) {
-        if (hooks[i].active && hooks[i].virtual_address == aligned_addr) {
-            return &hooks[i];
+    struct HookEntry** leaf = hook_directory[address >> 22];
+    if (!leaf)
+        return 0;
+    return leaf[(address >> 12) & 0x3FF];
+}
+
+// --- HOOK LATENCY STATS ---
+// One trapped access = one fault (or fault + debug trap) handler invocation.
+uint64 stat_entry = 0;     // Handler entered
+uint64 stat_cb_first = 0;  // First device callback started, 0 = no callback yet
+uint64 stat_cb_last = 0;   // Last device callback returned
+uint64 stat_cb_cycles = 0; // Cycles spent inside device callbacks
+
+void stats_begin() {
+    stat_entry = rdtsc();
+    stat_cb_first = 0;
+    stat_cb_cycles = 0;
+}
+
+uint64 stats_callback_begin() {
+    uint64 now = rdtsc();
+    if (!stat_cb_first)
+        stat_cb_first = now;
+    return now;
+}
+
+void stats_callback_end(uint64 start) {
+    stat_cb_last = rdtsc();
+    stat_cb_cycles += stat_cb_last - start;
+}
+
+void histogram_add(uint32* buckets, uint64 cycles) {
+    // Bucket = index of the highest set bit
+    int n = 0;
+    while (cycles > 1 && n < HOOK_HIST_BUCKETS - 1) {
+        cycles >>= 1;
+        n++;
+    }
+    buckets[n]++;
+}
+
+// Called right before returning to the guest
+void stats_end(struct HookEntry* hook) {
+    if (!stat_cb_first || !hook->stats)
+        return;
+
+    histogram_add(hook->stats->entry_to_callback, stat_cb_first - stat_entry);
+    histogram_add(hook->stats->callback, stat_cb_cycles);
+    histogram_add(hook->stats->callback_to_exit, rdtsc() - stat_cb_last);
+}
+
+int get_hook_stats(uint32 address, struct HookStats* out, int reset) {
+    struct HookEntry* hook = find_hook(address);
+    if (!hook)
+        return HOOK_ERR_NOT_FOUND;
+
+    if (out)
+        memcpy(out, hook->stats, sizeof(struct HookStats));
+    if (reset)
+        memset(hook->stats, 0, sizeof(struct HookStats));
+    return HOOK_OK;
+}
+
+// Hooks a page with a register map. Registers are looked up per 32-bit word,
+// so at most one register may live in each word of the page.
+int register_mmio_hook(uint32 address, struct MMIORegister* regs, int count) {
+    if (count <= 0 || count > MAX_REGS_PER_PAGE)
+        return HOOK_ERR_INVALID;
+
+    for (int i = 0; i < count; i++) {
+        int width = regs[i].width;
+        if ((width != 1 && width != 2 && width != 4) ||
+            (regs[i].offset & (width - 1)) || regs[i].offset + width > 4096)
+            return HOOK_ERR_INVALID;
+
+        // reg_index has one slot per word
+        for (int j = 0; j < i; j++) {
+            if ((regs[j].offset >> 2) == (regs[i].offset >> 2))
+                return HOOK_ERR_INVALID;
+        }
+    }
+
+    int result = register_hook(address, 0);
+    if (result != HOOK_OK)
+        return result;
+
+    struct HookEntry* hook = find_hook(address);
+    if (!hook->reg_index) {
+        hook->reg_index = (uint8*)alloc_small(1024);
+        if (!hook->reg_index) {
+            unregister_hook(address);
+            print("ERR: Out of memory for hook\n");
+            return HOOK_ERR_NO_MEMORY;
+        }
+    }
+
+    memset(hook->reg_index, 0, 1024);
+
+    for (int i = 0; i < count; i++) {
+        regs[i].value = regs[i].reset_value;
+        hook->reg_index[regs[i].offset >> 2] = i + 1;
+    }
+    hook->regs = regs;
+
+    return HOOK_OK;
+}
+
+struct MMIORegister* find_register(struct HookEntry* hook, uint32 address) {
+    if (!hook->regs)
+        return 0;
+
+    uint32 offset = address & 0xFFF;
+    uint8 n = hook->reg_index[offset >> 2];
+    if (!n)
+        return 0;
+
+    // Narrow registers only cover part of their word
+    struct MMIORegister* reg = &hook->regs[n - 1];
+    if (offset < reg->offset || offset >= reg->offset + reg->width)
+        return 0;
+    return reg;
+}
+
+uint32 mmio_load(void* page, uint32 offset, int width) {
+    uint8* p = (uint8*)page + offset;
+    if (width == 1) return *p;
+    if (width == 2) return *(uint16*)p;
+    return *(uint32*)p;
+}
+
+void mmio_store(void* page, uint32 offset, int width, uint32 value) {
+    uint8* p = (uint8*)page + offset;
+    if (width == 1) *p = (uint8)value;
+    else if (width == 2) *(uint16*)p = (uint16)value;
+    else *(uint32*)p = value;
+}
+
+// Copies the register value into a shadow page so guest reads see it
+void sync_shadow(struct HookEntry* hook, struct MMIORegister* reg) {
+    if (hook->mode == HOOK_MODE_SHADOW)
+        mmio_store(hook->page_ptr, reg->offset, reg->width, reg->value);
+}
+
+int register_shadow_hook(uint32 address, struct MMIORegister* regs, int count) {
+    int result = register_mmio_hook(address, regs, count);
+    if (result != HOOK_OK)
+        return result;
+
+    struct HookEntry* hook = find_hook(address);
+    hook->mode = HOOK_MODE_SHADOW;
+    for (int i = 0; i < count; i++)
+        sync_shadow(hook, &regs[i]);
+
+    // Map Present but Read-Only (CR0.WP makes this hold for ring 0 too)
+    *hook->pte = (*hook->pte & ~2) | 1;
+    invlpg(hook->virtual_address);
+
+    return HOOK_OK;
+}
+
+int set_mmio_register(uint32 address, uint32 value) {
+    struct HookEntry* hook = find_hook(address);
+    struct MMIORegister* reg = hook ? find_register(hook, address) : 0;
+    if (!reg)
+        return HOOK_ERR_NOT_FOUND;
+
+    reg->value = value;
+    sync_shadow(hook, reg);
+    return HOOK_OK;
+}
+
+// --- POLLING LOOP DETECTION ---
+uint32 poll_eip = 0;
+uint32 poll_address = 0;
+int poll_count = 0;
+uint32 poll_fast_forwards = 0; // How many spin-waits were skipped
+
+// Reads a register on behalf of the guest. If the guest keeps re-reading it
+// from the same instruction, asks the model when the value will change and
+// jumps time forward so the loop sees the ready value right away.
+uint32 read_register(struct MMIORegister* reg, uint32 address, int width) {
+    uint64 start = stats_callback_begin();
+
+    if (reg->poll && active_eip != HOOK_RING_EIP) {
+        if (address == poll_address && active_eip == poll_eip) {
+            poll_count++;
+        } else {
+            poll_address = address;
+            poll_eip = active_eip;
+            poll_count = 1;
+        }
+
+        if (poll_count >= POLL_THRESHOLD) {
+            // A model that cannot tell is usually waiting for its next event
+            uint32 ticks = reg->poll(reg, address);
+            if (!ticks)
+                ticks = next_event_delay();
+            if (ticks) {
+                advance_ticks(ticks);
+                poll_fast_forwards++;
+                poll_count = 0;
+            }
         }
     }
-    return 0;
+
+    uint32 value = reg->read ? reg->read(reg, address, width) : reg->value;
+    stats_callback_end(start);
+    return value;
+}
+
+struct QueuedWrite write_queue[WRITE_QUEUE_SIZE];
+volatile uint32 write_queue_head = 0; // Next slot to fill (producer)
+volatile uint32 write_queue_tail = 0; // Next slot to drain (consumer)
+volatile int write_queue_running = 0;  // The handler of entry 'tail' is running
+
+void drain_write_queue() {
+    while (write_queue_tail != write_queue_head) {
+        struct QueuedWrite* w = &write_queue[write_queue_tail & (WRITE_QUEUE_SIZE - 1)];
+        write_queue_running = 1;
+        w->reg->write(w->reg, w->address, w->value, w->reg->width);
+        // On the guest core, whatever the handler did through smp_call_guest
+        // (run right away there) lands after write_register synced the shadow
+        // page. The peripheral core leaves the register and the page alone.
+        if (smp_cpu_index() == 0)
+            sync_shadow(w->hook, w->reg);
+        write_queue_running = 0;
+        write_queue_tail++;
+    }
+}
+
+void write_queue_drop_running() {
+    if (!write_queue_running)
+        return;
+
+    struct QueuedWrite* w = &write_queue[write_queue_tail & (WRITE_QUEUE_SIZE - 1)];
+    klog(KLOG_WRITE_DROPPED, w->value, w->address, 0);
+    write_queue_running = 0;
+    write_queue_tail++;
+}
+
+int write_queue_pending() {
+    return write_queue_tail != write_queue_head;
+}
+
+void queue_write(struct HookEntry* hook, struct MMIORegister* reg, uint32 address, uint32 value) {
+    // Full: catch up right here so ordering is kept and nothing is lost,
+    // or wait for the peripheral core to make room
+    while (write_queue_head - write_queue_tail == WRITE_QUEUE_SIZE) {
+        if (!smp_peripheral_online) {
+            drain_write_queue();
+            break;
+        }
+        // Interrupts are off, so the IPI that would empty guest_queue cannot
+        // come in. A handler waiting in smp_call_guest() for room there would
+        // never finish and never make room here; run its calls ourselves.
+        smp_run_guest_calls();
+        smp_kick_peripheral();
+        asm volatile("pause");
+    }
+
+    struct QueuedWrite* w = &write_queue[write_queue_head & (WRITE_QUEUE_SIZE - 1)];
+    w->hook = hook;
+    w->reg = reg;
+    w->address = address;
+    w->value = value;
+    w->timestamp = tick_counter;
+    asm volatile("" ::: "memory"); // Entry complete before the consumer sees it
+    write_queue_head++;
+    smp_kick_peripheral();
+}
+
+// Delivers a guest write to a register. Deferred registers latch the value
+// now and run their handler later from the write queue.
+void write_register(struct HookEntry* hook, struct MMIORegister* reg, uint32 address, uint32 value, int width) {
+    uint64 start = stats_callback_begin();
+
+    if (reg->flags & MMIO_REG_DEFERRED) {
+        reg->value = value;
+        if (reg->write)
+            queue_write(hook, reg, address, value);
+    } else if (reg->write) {
+        reg->write(reg, address, value, width);
+    } else {
+        reg->value = value;
+    }
+
+    // The handler may not keep what was written (e.g. write-1-to-clear)
+    sync_shadow(hook, reg);
+    stats_callback_end(start);
+}
+
+int call_page_callback(struct HookEntry* hook, uint32 address, int is_write) {
+    uint64 start = stats_callback_begin();
+    int result = hook->callback(address, hook->page_ptr, is_write);
+    stats_callback_end(start);
+    return result;
+}
+
+// Bytes of an access, from its first one, that hit the same register (or
+// the same lack of one)
+int access_span(struct HookEntry* hook, uint32 address, int width) {
+    struct MMIORegister* first = find_register(hook, address);
+    int n = 1;
+    while (n < width && find_register(hook, address + n) == first)
+        n++;
+    return n;
+}
+
+// One access that stays inside one register, or touches none
+uint32 hook_read_one(struct HookEntry* hook, uint32 address, int width) {
+    struct MMIORegister* reg = find_register(hook, address);
+
+    if (reg) {
+        // Shadow pages serve reads straight from the page, never from handlers
+        uint32 value = (hook->mode != HOOK_MODE_SHADOW)
+            ? read_register(reg, address, width) : reg->value;
+        // Hand out only the bytes that were accessed
+        value >>= ((address & 0xFFF) - reg->offset) * 8;
+        value &= width_mask(width);
+        trace_access(active_eip, address, value, width, 0);
+        return value;
+    }
+
+    if (hook->callback)
+        call_page_callback(hook, address, 0);
+    uint32 value = mmio_load(hook->page_ptr, address & 0xFFF, width);
+    trace_access(active_eip, address, value, width, 0);
+    return value;
+}
+
+void hook_write_one(struct HookEntry* hook, uint32 address, int width, uint32 value) {
+    struct MMIORegister* reg = find_register(hook, address);
+
+    // A write means the guest is doing work, not spinning
+    poll_count = 0;
+    trace_access(active_eip, address, value, width, 1);
+
+    if (reg) {
+        // Merge the stored bytes into the register
+        int shift = ((address & 0xFFF) - reg->offset) * 8;
+        uint32 mask = width_mask(width) << shift;
+        uint32 merged = (reg->value & ~mask) | ((value << shift) & mask);
+
+        write_register(hook, reg, address, merged, width);
+        return;
+    }
+
+    mmio_store(hook->page_ptr, address & 0xFFF, width, value);
+    if (hook->callback)
+        call_page_callback(hook, address, 1);
+}
+
+// An access that runs past the end of its register, or from a gap into one,
+// is split where the register changes: each register sees only its own
+// bytes, and bytes outside any register go to the page one at a time.
+uint32 hook_read(struct HookEntry* hook, uint32 address, int width) {
+    int n = access_span(hook, address, width);
+    if (n == width)
+        return hook_read_one(hook, address, width);
+
+    uint32 value = 0;
+    for (int i = 0; i < width; i += n) {
+        n = find_register(hook, address + i) ? access_span(hook, address + i, width - i) : 1;
+        value |= hook_read_one(hook, address + i, n) << (i * 8);
+    }
+    return value;
+}
+
+void hook_write(struct HookEntry* hook, uint32 address, int width, uint32 value) {
+    int n = access_span(hook, address, width);
+    if (n == width) {
+        hook_write_one(hook, address, width, value);
+        return;
+    }
+
+    for (int i = 0; i < width; i += n) {
+        n = find_register(hook, address + i) ? access_span(hook, address + i, width - i) : 1;
+        hook_write_one(hook, address + i, n, (value >> (i * 8)) & width_mask(n));
+    }
+}
+
+// The timer interrupt may process the ring between a trapped access and its
+// debug trap, which still needs the faulting EIP
+uint32 hook_ring_read(struct HookEntry* hook, uint32 address, int width) {
+    uint32 eip = active_eip;
+    active_eip = HOOK_RING_EIP;
+    uint32 value = hook_read(hook, address, width);
+    active_eip = eip;
+    return value;
+}
+
+void hook_ring_write(struct HookEntry* hook, uint32 address, int width, uint32 value) {
+    uint32 eip = active_eip;
+    active_eip = HOOK_RING_EIP;
+    hook_write(hook, address, width, value);
+    active_eip = eip;
 }
 
 void debug_handler(struct TrapFrame* tf) {
     // This runs AFTER the instruction executed (Single Step)
 
     if (active_write_hook) {
+        struct HookEntry* hook = active_write_hook;
+        stats_begin();
+
         // 1. If we were tracking a write, the data is now in RAM.
         // We call the callback so the user can see what was written.
 
-        // Pointer to the physical page where data sits
-        void* phys_mem = (void*)active_write_hook->virtual_address;
-
-        // Invoke Callback (is_write = 1)
-        active_write_hook->callback(active_write_hook->virtual_address, phys_mem, 1);
+        if (active_reg) {
+            // Register-granular: only the touched register sees the write.
+            // A read-modify-write ("OR [addr], 1") only faults as a read,
+            // so a register that changed under a read is a write too.
+            uint32 value = mmio_load(active_write_hook->page_ptr, active_reg->offset, active_reg->width);
+            if (active_is_write || value != active_value) {
+                trace_access(active_eip, active_address, value, active_reg->width, 1);
+                write_register(active_write_hook, active_reg, active_address, value, active_reg->width);
+            }
+        } else if (active_write_hook->callback) {
+            // Invoke Callback (is_write = 1)
+            trace_access(active_eip, active_address,
+                         mmio_load(active_write_hook->page_ptr, active_address & 0xFFC, 4), 4, 1);
+            call_page_callback(active_write_hook, active_address, 1);
+        }
 
-        // 2. Re-protect the page (Mark Not Present)
-        int pte_idx = active_write_hook->virtual_address / 4096;
-        first_page_table[pte_idx] &= ~1;
-        asm volatile("mov %cr3, %eax; mov %eax, %cr3");
+        // 2. Re-protect the page (Mark Not Present, or Read-Only for shadow pages)
+        if (active_write_hook->mode == HOOK_MODE_SHADOW)
+            *active_write_hook->pte &= ~2;
+        else
+            *active_write_hook->pte &= ~1;
+        invlpg(active_write_hook->virtual_address);
 
         // 3. Reset State
         active_write_hook = 0;
+        active_reg = 0;
+        stats_end(hook);
     }
 
     // 4. Clear Trap Flag
@@ -160,23 +733,46 @@ void page_fault_handler(struct TrapFrame* tf) {
     struct HookEntry* hook = find_hook(fault_addr);
 
     if (hook) {
-        int pte_idx = hook->virtual_address / 4096;
+        stats_begin();
+        active_eip = tf->eip;
+
+        // Fast path: decode the instruction and perform the access against the
+        // hook directly. One fault, no page mapping and no single step.
+        if (emulate_mmio(tf, hook, fault_addr)) {
+            vdso_hook_access(hook, tf->error_code & 2);
+            stats_end(hook);
+            return;
+        }
+
+        // Slow path: let the CPU execute the instruction on the real page and
+        // catch it afterwards with the Trap Flag.
 
         // Check Error Code Bit 1 (W/R): 1 = Write, 0 = Read
         int is_write_fault = (tf->error_code & 2);
 
+        active_address = fault_addr;
+        active_is_write = is_write_fault;
+        active_reg = find_register(hook, fault_addr);
+
         if (is_write_fault) {
             // --- WRITE INTERCEPTION ---
             // We need to let the write happen, then inspect it.
 
             // 1. Map Page as Writable (Present | RW)
-            first_page_table[pte_idx] |= 3;
-            asm volatile("mov %cr3, %eax; mov %eax, %cr3");
+            *hook->pte |= 3;
+            invlpg(hook->virtual_address);
 
-            // 2. Save context for the upcoming Debug Trap
+            // 2. Load the current register value so partial writes merge into it
+            poll_count = 0;
+            if (active_reg) {
+                active_value = active_reg->value;
+                mmio_store(hook->page_ptr, active_reg->offset, active_reg->width, active_value);
+            }
+
+            // 3. Save context for the upcoming Debug Trap
             active_write_hook = hook;
 
-            // 3. Set Trap Flag to catch CPU after the write finishes
+            // 4. Set Trap Flag to catch CPU after the write finishes
             tf->eflags |= 0x100;
 
         } else {
@@ -184,15 +780,24 @@ void page_fault_handler(struct TrapFrame* tf) {
             // The CPU wants data. We must provide it NOW.
 
             // 1. Temporarily Map Page (RW so we can fill it)
-            first_page_table[pte_idx] |= 3;
-            asm volatile("mov %cr3, %eax; mov %eax, %cr3");
+            *hook->pte |= 3;
+            invlpg(hook->virtual_address);
 
             // 2. Clear the page (optional)
             // memset((void*)hook->virtual_address, 0, 4096);
 
             // 3. Call Callback (is_write = 0)
             // The user function populates the memory at 'virtual_address'
-            hook->callback(hook->virtual_address, (void*)hook->virtual_address, 0);
+            if (active_reg) {
+                // Register-granular: ask only the touched register for its value
+                active_value = read_register(active_reg, fault_addr, active_reg->width);
+                mmio_store(hook->page_ptr, active_reg->offset, active_reg->width, active_value);
+                trace_access(active_eip, fault_addr, active_value, active_reg->width, 0);
+            } else if (hook->callback) {
+                call_page_callback(hook, fault_addr, 0);
+                trace_access(active_eip, fault_addr,
+                             mmio_load(hook->page_ptr, fault_addr & 0xFFC, 4), 4, 0);
+            }
 
             // 4. Set Page to Read-Only (Present | User) - Clear RW Bit
             // Why Read-Only? If the user instruction was "ADD [addr], 1" (Read-Modify-Write),
@@ -204,9 +809,17 @@ void page_fault_handler(struct TrapFrame* tf) {
             active_write_hook = hook; // Reuse 'active' logic to hide page after step
             tf->eflags |= 0x100;      // Trap after instruction
         }
+        vdso_hook_access(hook, is_write_fault);
+        stats_end(hook);
+    } else if (!(tf->error_code & 1) && fs_page_in(fault_addr)) {
+        // First touch of a lazily loaded FS page, retry the instruction
+    } else if ((tf->error_code & 3) == 3 && app_cow_fault(fault_addr)) {
+        // First write to a shared app page, retry on the private copy
     } else {
         // Real Page Fault (Crash)
+        klog_flush();
         print("CRASH: Invalid Access");
+        console_flush();
         while(1);
     }
 }
@@ -232,9 +845,11 @@ void init_paging() {
     asm volatile("mov %0, %%cr3" :: "r"(&page_directory));
 
     // 5. Enable Paging in CR0 (Bit 31)
+    // Also set Write Protect (Bit 16) so Read-Only pages fault in ring 0,
+    // where the guest runs. Shadow hooks rely on it.
     uint32 cr0;
     asm volatile("mov %%cr0, %0" : "=r"(cr0));
-    cr0 |= 0x80000000;
+    cr0 |= 0x80010000;
     asm volatile("mov %0, %%cr0" :: "r"(cr0));
 }
 
@@ -245,103 +860,223 @@ int strcmp(const char* s1, const char* s2) {
     return *(const unsigned char*)s1 - *(const unsigned char*)s2;
 }
 
-void memcpy(char* dest, char* src, int count) {
-    for (int i=0; i<count; i++) dest[i] = src[i];
+// --- SECRET VAULT DEVICE ---
+// One 32-bit DATA register at offset 0x00 of the vault page.
+#define VAULT_DEVICE_ADDR 0x1F0000
+
+uint32 vault_data_read(struct MMIORegister* reg, uint32 address, int width) {
+    // The CPU is about to read. We must provide data.
+    // Let's return a dynamic value (e.g., a counter)
+    static int counter = 0;
+    counter++;
+
+    // Runs inside the guest's page fault: log now, format in the idle loop
+    klog(KLOG_VAULT_READ, 0xCAFEBABE + counter, 0, 0);
+    return 0xCAFEBABE + counter;
 }
 
-int secret_vault_device(uint32 address, void* page_ptr, int is_write) {
-    int* data_ptr = (int*)page_ptr;
+// Guest core (smp_call_guest): puts DATA back to its reset value
+void vault_reset(void* arg) {
+    struct MMIORegister* reg = (struct MMIORegister*)arg;
+    set_mmio_register(VAULT_DEVICE_ADDR + reg->offset, reg->reset_value);
+}
 
-    if (is_write) {
-        // The CPU just wrote to our memory. Let's see what it is.
-        int val = *data_ptr;
+// Deferred: runs from the write queue, off the guest's fault path.
+// write_register has already latched 'value' into the register.
+void vault_data_write(struct MMIORegister* reg, uint32 address, uint32 value, int width) {
+    klog(KLOG_VAULT_WRITE, value, 0, 0);
 
-        // (Hex conversion logic omitted for brevity, let's assume raw int print)
-        print("Write Detected! New value: ");
-        print_hex(val);
+    // Logic: If they wrote 0xFFFF, reset the device
+    if (value == 0xFFFF) {
+        klog(KLOG_VAULT_RESET, 0, 0, 0);
+        smp_call_guest(vault_reset, reg);
+    }
+}
 
-        // Logic: If they wrote 0xFFFF, reset the device
-        if (val == 0xFFFF) {
-            print("Device RESET command received");
-        }
+struct MMIORegister secret_vault_registers[] = {
+    // offset, width, read,            write,            reset,      value, poll, flags
+    {  0x00,   4,     vault_data_read, vault_data_write, 0x00000000, 0,     0,    MMIO_REG_DEFERRED },
+};
 
-    } else {
-        // The CPU is about to read. We must provide data.
-        // Let's return a dynamic value (e.g., a counter)
-        static int counter = 0;
-        counter++;
+uint32 app_mapped_pages = 0; // Pages of the app range not identity mapped (FS alias or write protected)
 
-        *data_ptr = 0xCAFEBABE + counter;
+// Puts the app range back to its identity mapping
+void unmap_app() {
+    for (uint32 i = 0; i < app_mapped_pages; i++) {
+        uint32 page = APP_BASE + i * 4096;
+        *get_pte(page) = page | 3;
+        invlpg(page);
+    }
+    app_mapped_pages = 0;
+}
 
-        print("Read Detected! Data injected.");
+// Points the app range at the file's pages in the FS window: read-only and
+// PTE_COW, or not present with PTE_FS_LAZY if the FS page is not loaded yet.
+// FS_FILE_READONLY files get no PTE_COW, so a write to them is a fatal fault.
+// Returns 0 if the file cannot be mapped (version 1 images are not page aligned).
+int map_app(struct FSFile* file) {
+    if (((uint32)file->data & 0xFFF) || file->size > APP_MAX_SIZE)
+        return 0;
+
+    uint32 cow = (file->flags & FS_FILE_READONLY) ? 0 : PTE_COW;
+    uint32 pages = (file->size + 4095) / 4096;
+    for (uint32 i = 0; i < pages; i++) {
+        uint32 page = APP_BASE + i * 4096;
+        uint32 frame = (uint32)file->data + i * 4096;
+        uint32 present = (*get_pte(frame) & PTE_FS_LAZY) ? PTE_FS_LAZY : 1;
+
+        *get_pte(page) = frame | cow | present;
+        invlpg(page);
     }
+    app_mapped_pages = pages;
+    return 1;
+}
+
+// Write to a shared app page: give it its own copy in the identity frame
+// below it (the app range is identity mapped when not aliased).
+// Returns 1 if the fault was handled.
+int app_cow_fault(uint32 address) {
+    if (address < APP_BASE || address >= APP_BASE + APP_MAX_SIZE)
+        return 0;
+
+    uint32 page = address & 0xFFFFF000;
+    uint32* pte = get_pte(page);
+    if ((*pte & (PTE_COW | 1)) != (PTE_COW | 1))
+        return 0;
+
+    uint32 frame = *pte & 0xFFFFF000;
+    *pte = page | 3;
+    invlpg(page);
+    memcpy((void*)page, (void*)frame, 4096);
     return 1;
 }
 
+// Maps (or, for unaligned files, copies) an app to its link address (0x20000) and calls it
+void run_app(struct FSFile* file) {
+    char* execution_location = (char*)APP_BASE;
+
+    if (!(file->flags & FS_FILE_EXEC)) {
+        print("ERR: File is not executable\n");
+        return;
+    }
+    if (!fs_verify(file)) {
+        print("ERR: App checksum mismatch\n");
+        return;
+    }
+
+    // Whatever the previous app wrote is dropped with its mapping
+    unmap_app();
+    ioring_reset();
+    vtimer_reset();
+    if (!map_app(file)) {
+        memcpy(execution_location, file->data, file->size);
+
+        // A copied read-only file is write protected in place; unmap_app
+        // makes the range writable again
+        if (file->flags & FS_FILE_READONLY) {
+            app_mapped_pages = (file->size + 4095) / 4096;
+            for (uint32 i = 0; i < app_mapped_pages; i++) {
+                uint32 page = APP_BASE + i * 4096;
+                *get_pte(page) = page | 1;
+                invlpg(page);
+            }
+        }
+    }
+
+    print("Running App at 0x20000...\n");
+
+    FunctionPtr app_entry = (FunctionPtr)execution_location;
+    app_entry();
+}
+
 void kern_main() {
+    bench_boot_phase("start");
+    init_mem();
     print("Loading IDT");
     setup_idt_entry(1, (uint32)isr1_wrapper);  // Debug
     setup_idt_entry(14, (uint32)isr14_wrapper); // Page Fault
     remap_pic();
     setup_idt_entry(32, (uint32)isr_timer_wrapper);
     setup_idt_entry(33, (uint32)isr_keyboard_wrapper);
+    setup_idt_entry(36, (uint32)isr_serial_wrapper); // IRQ4 (COM1)
+    setup_idt_entry(46, (uint32)isr_ata_wrapper); // IRQ14 (slave PIC base 0x28 + 6)
+    setup_idt_entry(TIMER_LAPIC_VECTOR, (uint32)isr_lapic_timer_wrapper);
+    setup_idt_entry(TIMER_SPURIOUS, (uint32)isr_spurious);
+    setup_idt_entry(SMP_IPI_VECTOR, (uint32)isr_smp_ipi_wrapper);
     setup_idt_entry(0x80, (uint32)isr80);
     load_idt(idt, sizeof(idt) - 1);
+    init_sysenter();
+    ioring_reset(); // The timer interrupt checks the guest request ring from its first tick
 
-    // Disable IRQ14
-    uint8 mask = inb(0xA1);
-    mask |= (1 << 6); // Set bit 6
-    outb(0xA1, mask);
-
-    // Unmask Timer IRQ0
-    outb(0x21, inb(0x21) & 0xFE);
+    // IRQ14 completes queued disk requests
+    ata_init_irq();
 
-    // Configure 50us Timer
+    // Configure 50us Timer (boot only, see init_timer)
     init_pit_50us();
 
     // Unmask IRQ0 (Timer) on PIC
     outb(0x21, inb(0x21) & 0xFE);
 
+    bench_boot_phase("interrupts");
+
     init_acpi();
+    init_serial();
+    init_trace();
+    bench_boot_phase("acpi");
 
-    char* fs_base = (char*) 0x200000;
-    // NOTE: ATA LBA 17 is exactly where we put the FS in build_fs.py
+    // NOTE: ATA LBA 128 (FS_LBA) is exactly where we put the FS in build_fs.py
     print("Loading Filesystem...");
-    ata_read_sectors(64, 2500, fs_base);
-    print("Done.\n");
-    init_paging();
+    fs_load_start();
 
-    if (fs_base[0] != 'F' || fs_base[1] != 'S') {
-        print("ERR: FS Magic Fail");
-        while(1);
-    }
+    // Paging and hooks are set up while IRQ14 brings the FS header in.
+    // The FS buffer is identity mapped, so DMA and PIO are unaffected by the CR3 switch.
+    asm volatile("sti");
+    init_paging();
+    init_vdso();
 
-    uint16 file_count = *(uint16*)(fs_base + 2);
-    char* headers_start = fs_base + 4;
-    char* data_start = headers_start + (file_count * sizeof(struct FileHeader));
-    struct FileHeader* current_file = (struct FileHeader*) headers_start;
+    if (register_mmio_hook(VAULT_DEVICE_ADDR, secret_vault_registers, 1) != HOOK_OK)
+        print("ERR: Hook registration failed\n");
+    init_vtimer();
 
-    register_hook(0x1F0000, secret_vault_device);
+    bench_boot_phase("paging_hooks");
 
-    asm volatile("sti");
+    // LAPIC (mapped through the page tables) replaces the 20kHz PIT
+    init_timer();
+    bench_boot_phase("timer");
 
-    for (int i = 0; i < file_count; i++) {
-        if (strcmp(current_file->name, "app.bin") == 0) {
-            char* file_content = data_start + current_file->offset;
-            char* execution_location = (char*)0x20000;
+    // Second CPU for the device models (MADT from init_acpi, LAPIC from init_timer)
+    init_smp();
+    bench_boot_phase("smp");
 
-            memcpy(execution_location, file_content, current_file->size);
+    // File contents are paged in from disk on first touch (see fs_page_in)
+    if (!fs_load_finish()) {
+        print("ERR: FS Magic Fail");
+        console_flush();
+        while(1);
+    }
+    print("Done.\n");
+    bench_boot_phase("fs_load");
 
-            print("Running App at 0x20000...\n");
+    // Benchmark images carry bench_*.bin apps; this only returns if there are none
+    run_benchmarks();
 
-            FunctionPtr app_entry = (FunctionPtr)execution_location;
-            app_entry();
-            break;
-        }
-        current_file++;
-    }
+    struct FSFile app;
+    if (fs_find("app.bin", &app))
+        run_app(&app);
 
     print("HLT");
-    while(1)
-        asm volatile("hlt");
+    while(1) {
+        // Drain with interrupts off so the timer tick cannot drain concurrently
+        asm volatile("cli");
+        smp_peripheral_work();
+        smp_run_guest_calls();
+        // Nothing to do but wait for a device: skip straight to its event
+        int busy = vclock_idle();
+        asm volatile("sti");
+        trace_flush();
+        klog_flush();
+        console_flush();
+        if (!busy)
+            asm volatile("hlt");
+    }
 }
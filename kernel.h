@@ -4,6 +4,7 @@
 typedef unsigned char uint8;
 typedef unsigned short uint16;
 typedef unsigned int uint32;
+typedef unsigned long long uint64;
 
 // Structure representing the stack after 'isr14_wrapper' pushes everything
 struct TrapFrame {
@@ -31,8 +32,73 @@ struct IDTEntry {
     unsigned short offset_high;
 } __attribute__((packed));
 
+// Fills entry 'n' of an IDT (the boot CPU's, or an AP's own table)
+void set_idt_gate(struct IDTEntry* table, int n, unsigned int handler);
 
 typedef void (*TimerCallback)(void);
+extern TimerCallback user_timer_callback;
 void register_timer_handler(TimerCallback cb);
 
+int strcmp(const char* s1, const char* s2);
+struct FSFile;
+void run_app(struct FSFile* file);
+
+// Time base for device models, in timer ticks (50us). See vclock.h
+extern uint32 tick_counter;
+void advance_ticks(uint32 ticks);
+
+// --- KERNEL HEAP ---
+// Identity-mapped physical pages handed out by alloc_page().
+// Sits between the kernel .bss (0x100000, see link.ld) and the hook device page at 0x1F0000.
+#define KERNEL_HEAP_START 0x140000
+#define KERNEL_HEAP_END   0x1F0000
+
+// --- APP MAPPING ---
+// Apps run at their link address. Page-aligned files are mapped there
+// read-only, straight from the FS window, and copied page by page on the
+// first write (PTE_COW) into the identity frame underneath.
+#define APP_BASE     0x20000
+#define APP_MAX_SIZE 0x60000 // Up to 0x80000, below the boot stack at 0x90000
+#define PTE_COW      0x400   // PTE available bit: shared FS page, copy on write
+
+int app_cow_fault(uint32 address);
+
+void* alloc_page();
+void* alloc_pages(int count);
+void* alloc_small(uint32 size);
+uint32* get_pte(uint32 address);
+
+static inline uint64 rdtsc() {
+    uint32 lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64)hi << 32) | lo;
+}
+
+static inline uint64 rdmsr(uint32 msr) {
+    uint32 lo, hi;
+    asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32 msr, uint64 value) {
+    asm volatile("wrmsr" : : "c"(msr), "a"((uint32)value), "d"((uint32)(value >> 32)));
+}
+
+// Drops the TLB entry of one page instead of reloading CR3
+static inline void invlpg(uint32 address) {
+    asm volatile("invlpg (%0)" : : "r"(address) : "memory");
+}
+
+// Disables interrupts, returning the previous EFLAGS for irq_restore()
+static inline uint32 irq_save() {
+    uint32 flags;
+    asm volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint32 flags) {
+    if (flags & 0x200)
+        asm volatile("sti" : : : "memory");
+}
+
 #endif
\ No newline at end of file
@@ -2,7 +2,17 @@
 
 [bits 32]
 [extern kern_main] ; Define calling point. Must match function name in C file
+[extern bss_start] ; From link.ld
+[extern bss_end]
+
+; .bss is not part of the loaded image, clear it before any C code runs
+mov edi, bss_start
+mov ecx, bss_end
+sub ecx, edi
+xor eax, eax
+cld
+rep stosb
 
 mov eax, kern_main
 call eax
-jmp $         ; Hang if main returns
\ No newline at end of file
+jmp $         ; Hang if main returns
@@ -0,0 +1,114 @@
+// klog.c
+#include "klog.h"
+#include "print.h"
+#include "mem.h"
+
+struct KLogRing klog_rings[SMP_MAX_CPUS];
+
+const char* klog_formats[KLOG_FORMATS] = {
+    [KLOG_VAULT_READ]       = "Read Detected! Data injected: %x\n",
+    [KLOG_VAULT_WRITE]      = "Write Detected! New value: %x\n",
+    [KLOG_VAULT_RESET]      = "Device RESET command received\n",
+    [KLOG_KEY_PRESSED]      = "Key Pressed: %x\n",
+    [KLOG_TIMER_REGISTERED] = "Timer Handler Registered! (%x)\n",
+    [KLOG_AP_FAULT]         = "SMP: peripheral core exception %u at %x (CR2 %x), halted\n",
+    [KLOG_WRITE_DROPPED]    = "SMP: dropped write of %x to %x (handler faulted)\n",
+};
+
+void print_dec(uint32 n) {
+    char digits[11];
+    int count = 0;
+    do {
+        digits[count++] = '0' + n % 10;
+        n /= 10;
+    } while (n);
+
+    char text[11];
+    for (int i = 0; i < count; i++)
+        text[i] = digits[count - 1 - i];
+    text[count] = 0;
+    print(text);
+}
+
+void klog_format(struct KLogRecord* r) {
+    if (r->format >= KLOG_FORMATS) {
+        print("[klog: bad format ");
+        print_hex(r->format);
+        print("]\n");
+        return;
+    }
+
+    // Literal runs are printed in pieces between the conversions
+    const char* f = klog_formats[r->format];
+    char text[64];
+    int n = 0;
+    int arg = 0;
+    for (; *f; f++) {
+        if (f[0] == '%' && (f[1] == 'x' || f[1] == 'u') && arg < 3) {
+            text[n] = 0;
+            print(text);
+            n = 0;
+            if (f[1] == 'x')
+                print_hex(r->args[arg++]);
+            else
+                print_dec(r->args[arg++]);
+            f++;
+            continue;
+        }
+        text[n++] = *f;
+        if (n == sizeof(text) - 1) {
+            text[n] = 0;
+            print(text);
+            n = 0;
+        }
+    }
+    text[n] = 0;
+    print(text);
+}
+
+void klog_flush_ring(struct KLogRing* ring) {
+
+    while (ring->tail != ring->head) {
+        // Producers lapped us: skip to the oldest record still in the ring
+        if (ring->head - ring->tail > KLOG_RECORDS) {
+            uint32 oldest = ring->head - KLOG_RECORDS;
+            ring->lost += oldest - ring->tail;
+            ring->tail = oldest;
+        }
+
+        struct KLogRecord* slot = &ring->records[ring->tail & (KLOG_RECORDS - 1)];
+        if (slot->seq != ring->tail + 1) {
+            // Claimed but still being filled, or already overwritten
+            // by a newer record
+            if ((int)(slot->seq - (ring->tail + 1)) > 0) {
+                ring->lost++;
+                ring->tail++;
+                continue;
+            }
+            break;
+        }
+
+        // Copy, then check nobody reused the slot while we were copying
+        struct KLogRecord r;
+        memcpy(&r, slot, sizeof(r));
+        if (slot->seq != r.seq) {
+            ring->lost++;
+            ring->tail++;
+            continue;
+        }
+        ring->tail++;
+        klog_format(&r);
+    }
+
+    if (ring->lost) {
+        print("[klog: ");
+        print_dec(ring->lost);
+        print(" records lost]\n");
+        ring->lost = 0;
+    }
+}
+
+void klog_flush() {
+    for (int cpu = 0; cpu < SMP_MAX_CPUS; cpu++)
+        klog_flush_ring(&klog_rings[cpu]);
+}
@@ -0,0 +1,68 @@
+#ifndef KLOG_H
+#define KLOG_H
+// klog.h
+
+#include "kernel.h"
+#include "smp.h"
+
+// --- DEFERRED KERNEL LOG ---
+// For code running in fault, trap and interrupt context. klog() stores a
+// format ID and raw arguments in a ring and returns; nothing is formatted
+// and no console state is touched. klog_flush() (idle loop) formats the
+// records later.
+//
+// The ring never blocks and takes no lock: a producer claims a slot with a
+// single xadd (atomic against interrupts on its own CPU), fills it and
+// publishes it by writing 'seq' last. When producers lap the consumer the
+// oldest records are overwritten; the consumer notices from 'seq' and
+// reports how many were lost.
+#define KLOG_RECORDS 256 // Per CPU, must be a power of two
+
+// Format IDs, index into klog_formats[] (klog.c).
+// Formats take %x (0x%08X) and %u (decimal) for the arguments in order.
+#define KLOG_VAULT_READ       0
+#define KLOG_VAULT_WRITE      1
+#define KLOG_VAULT_RESET      2
+#define KLOG_KEY_PRESSED      3
+#define KLOG_TIMER_REGISTERED 4
+#define KLOG_AP_FAULT         5
+#define KLOG_WRITE_DROPPED    6
+#define KLOG_FORMATS          7
+
+struct KLogRecord {
+    uint32 seq;       // Slot number + 1 once published, so 0 is never valid
+    uint16 format;    // KLOG_*
+    uint16 reserved;
+    uint32 args[3];
+};
+
+struct KLogRing {
+    struct KLogRecord records[KLOG_RECORDS];
+    volatile uint32 head; // Next slot to claim (producers)
+    uint32 tail;          // Next slot to format (klog_flush)
+    uint32 lost;          // Overwritten before they were formatted
+};
+
+// One ring per CPU (smp_cpu_index), all formatted by the boot CPU
+extern struct KLogRing klog_rings[SMP_MAX_CPUS];
+
+static inline void klog(uint16 format, uint32 arg0, uint32 arg1, uint32 arg2) {
+    struct KLogRing* ring = &klog_rings[smp_cpu_index()];
+
+    uint32 slot = 1;
+    asm volatile("xaddl %0, %1" : "+r"(slot), "+m"(ring->head) : : "memory");
+
+    struct KLogRecord* r = &ring->records[slot & (KLOG_RECORDS - 1)];
+    r->seq = 0; // Unpublished while it is being filled
+    asm volatile("" : : : "memory");
+    r->format = format;
+    r->args[0] = arg0;
+    r->args[1] = arg1;
+    r->args[2] = arg2;
+    asm volatile("" : : : "memory");
+    r->seq = slot + 1;
+}
+
+// Formats and prints every published record. Call from idle context.
+void klog_flush();
+#endif
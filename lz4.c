@@ -0,0 +1,68 @@
+// lz4.c
+#include "lz4.h"
+#include "mem.h"
+
+// Reads a length continued in 255-valued bytes; returns 0 past the end of input
+const uint8* lz4_length(const uint8* ip, const uint8* iend, uint32* length) {
+    uint8 b;
+    do {
+        if (ip >= iend)
+            return 0;
+        b = *ip++;
+        *length += b;
+    } while (b == 255);
+    return ip;
+}
+
+int lz4_decompress(const uint8* src, uint32 src_len, uint8* dst, uint32 dst_capacity) {
+    const uint8* ip = src;
+    const uint8* iend = src + src_len;
+    uint8* op = dst;
+    uint8* oend = dst + dst_capacity;
+
+    while (ip < iend) {
+        // 1. Token: literal length (high nibble), match length - 4 (low nibble)
+        uint8 token = *ip++;
+        uint32 length = token >> 4;
+        if (length == 15 && !(ip = lz4_length(ip, iend, &length)))
+            return -1;
+
+        // 2. Literals
+        if (length > (uint32)(iend - ip) || length > (uint32)(oend - op))
+            return -1;
+        memcpy(op, ip, length);
+        op += length;
+        ip += length;
+
+        // The last sequence has no match
+        if (ip == iend)
+            break;
+
+        // 3. Match: copy from 'offset' bytes back
+        if (iend - ip < 2)
+            return -1;
+        uint32 offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (uint32)(op - dst))
+            return -1;
+
+        length = token & 15;
+        if (length == 15 && !(ip = lz4_length(ip, iend, &length)))
+            return -1;
+        length += 4;
+        if (length > (uint32)(oend - op))
+            return -1;
+
+        // An overlapping match repeats the last 'offset' bytes, byte by byte
+        const uint8* match = op - offset;
+        if (offset >= length) {
+            memcpy(op, match, length);
+            op += length;
+        } else {
+            for (uint32 i = 0; i < length; i++)
+                *op++ = *match++;
+        }
+    }
+
+    return op - dst;
+}
@@ -0,0 +1,11 @@
+#ifndef LZ4_H
+#define LZ4_H
+// lz4.h
+
+#include "kernel.h"
+
+// Decodes one LZ4 block (block format, no frame header) from 'src' into 'dst'.
+// Returns the decompressed size, or -1 if the block is malformed or would
+// not fit in 'dst_capacity'.
+int lz4_decompress(const uint8* src, uint32 src_len, uint8* dst, uint32 dst_capacity);
+#endif
@@ -0,0 +1,209 @@
+// mem.c
+#include "mem.h"
+#include "print.h"
+#include "smp.h"
+
+int mem_has_sse2 = 0;
+
+void init_mem() {
+    uint32 eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+
+    uint32 needed = CPUID_EDX_FXSR | CPUID_EDX_SSE | CPUID_EDX_SSE2;
+    if ((edx & needed) != needed) {
+        print("No SSE2, memory copies use rep movsd\n");
+        return;
+    }
+
+    mem_has_sse2 = 1;
+    init_mem_cpu();
+}
+
+void init_mem_cpu() {
+    if (!mem_has_sse2)
+        return;
+
+    // CR0: FPU present (clear EM, TS), set MP and NE (native FPU errors)
+    uint32 cr0;
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    cr0 = (cr0 & ~0xC) | 0x22;
+    asm volatile("mov %0, %%cr0" :: "r"(cr0));
+
+    // CR4: OSFXSR (SSE instructions allowed) and OSXMMEXCPT
+    uint32 cr4;
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= 0x600;
+    asm volatile("mov %0, %%cr4" :: "r"(cr4));
+
+    // Default control words: every x87 and SSE exception masked
+    asm volatile("fninit");
+}
+
+// The SSE paths use XMM0-3 without saving them, so they may only run where
+// nobody else's XMM state is live. On the guest core that is code running
+// with interrupts on (the idle loop, run_app): every way in from the guest
+// is an interrupt gate or SYSENTER, which clear IF, so a handler for a
+// guest fault, interrupt or syscall (and anything it interrupted in the
+// kernel) takes the string instruction path instead. The peripheral core
+// never runs the guest. The kernel itself is built without SSE, so the
+// compiler never keeps anything in XMM registers.
+static inline int sse_allowed() {
+    if (!mem_has_sse2)
+        return 0;
+    if (smp_cpu_index() != 0)
+        return 1;
+
+    uint32 eflags;
+    asm volatile("pushf; pop %0" : "=r"(eflags));
+    return (eflags & 0x200) != 0;
+}
+
+static inline void copy_forward(uint8* d, const uint8* s, uint32 count) {
+    uint32 dwords = count >> 2;
+    uint32 bytes = count & 3;
+    asm volatile("rep movsl\n\t"
+                 "mov %3, %%ecx\n\t"
+                 "rep movsb"
+                 : "+D"(d), "+S"(s), "+c"(dwords)
+                 : "r"(bytes)
+                 : "memory");
+}
+
+// Top down, for overlapping moves to a higher address: the trailing bytes
+// first, then the dwords below them
+static inline void copy_backward(uint8* d, const uint8* s, uint32 count) {
+    uint32 dwords = count >> 2;
+    uint32 bytes = count & 3;
+    d += count - 1;
+    s += count - 1;
+    asm volatile("std\n\t"
+                 "rep movsb\n\t"
+                 "sub $3, %%esi\n\t"
+                 "sub $3, %%edi\n\t"
+                 "mov %3, %%ecx\n\t"
+                 "rep movsl\n\t"
+                 "cld"
+                 : "+D"(d), "+S"(s), "+c"(bytes)
+                 : "r"(dwords)
+                 : "memory");
+}
+
+static inline void fill_forward(uint8* d, uint32 pattern, uint32 count) {
+    uint32 dwords = count >> 2;
+    uint32 bytes = count & 3;
+    asm volatile("rep stosl\n\t"
+                 "mov %3, %%ecx\n\t"
+                 "rep stosb"
+                 : "+D"(d), "+c"(dwords)
+                 : "a"(pattern), "r"(bytes)
+                 : "memory");
+}
+
+// count >= MEM_SSE_MIN. Aligns the destination, then moves 64 bytes per
+// iteration. Forward only, but safe for dest < src: every block is loaded
+// before any of it is stored.
+__attribute__((target("sse2")))
+static void copy_sse2(uint8* d, const uint8* s, uint32 count) {
+    uint32 head = (16 - ((uint32)d & 15)) & 15;
+    copy_forward(d, s, head);
+    d += head;
+    s += head;
+    count -= head;
+
+    for (uint32 blocks = count >> 6; blocks; blocks--) {
+        asm volatile("movdqu   (%1), %%xmm0\n\t"
+                     "movdqu 16(%1), %%xmm1\n\t"
+                     "movdqu 32(%1), %%xmm2\n\t"
+                     "movdqu 48(%1), %%xmm3\n\t"
+                     "movdqa %%xmm0,   (%0)\n\t"
+                     "movdqa %%xmm1, 16(%0)\n\t"
+                     "movdqa %%xmm2, 32(%0)\n\t"
+                     "movdqa %%xmm3, 48(%0)"
+                     :
+                     : "r"(d), "r"(s)
+                     : "memory", "xmm0", "xmm1", "xmm2", "xmm3");
+        d += 64;
+        s += 64;
+    }
+    copy_forward(d, s, count & 63);
+}
+
+__attribute__((target("sse2")))
+static void fill_sse2(uint8* d, uint32 pattern, uint32 count) {
+    uint32 head = (16 - ((uint32)d & 15)) & 15;
+    fill_forward(d, pattern, head);
+    d += head;
+    count -= head;
+
+    // One asm block: XMM0 has to hold the pattern across the whole loop
+    uint32 blocks = count >> 6;
+    asm volatile("movd %2, %%xmm0\n\t"
+                 "pshufd $0, %%xmm0, %%xmm0\n"
+                 "1:\n\t"
+                 "movdqa %%xmm0,   (%0)\n\t"
+                 "movdqa %%xmm0, 16(%0)\n\t"
+                 "movdqa %%xmm0, 32(%0)\n\t"
+                 "movdqa %%xmm0, 48(%0)\n\t"
+                 "add $64, %0\n\t"
+                 "dec %1\n\t"
+                 "jnz 1b"
+                 : "+r"(d), "+r"(blocks)
+                 : "r"(pattern)
+                 : "memory", "xmm0");
+    fill_forward(d, pattern, count & 63);
+}
+
+void* memcpy(void* dest, const void* src, uint32 count) {
+    if (count >= MEM_SSE_MIN && sse_allowed()) {
+        copy_sse2((uint8*)dest, (const uint8*)src, count);
+    } else {
+        copy_forward((uint8*)dest, (const uint8*)src, count);
+    }
+    return dest;
+}
+
+void* memmove(void* dest, const void* src, uint32 count) {
+    uint8* d = (uint8*)dest;
+    const uint8* s = (const uint8*)src;
+
+    // Only a move to a higher, overlapping address has to run backwards
+    if (d <= s || d >= s + count)
+        return memcpy(dest, src, count);
+
+    copy_backward(d, s, count);
+    return dest;
+}
+
+void* memset(void* dest, int value, uint32 count) {
+    uint32 pattern = (uint8)value * 0x01010101;
+    if (count >= MEM_SSE_MIN && sse_allowed()) {
+        fill_sse2((uint8*)dest, pattern, count);
+    } else {
+        fill_forward((uint8*)dest, pattern, count);
+    }
+    return dest;
+}
+
+int memcmp(const void* a, const void* b, uint32 count) {
+    const uint8* p = (const uint8*)a;
+    const uint8* q = (const uint8*)b;
+
+    // Skip equal dwords, then find the byte that differs
+    while (count >= 4 && *(const uint32*)p == *(const uint32*)q) {
+        p += 4;
+        q += 4;
+        count -= 4;
+    }
+    for (uint32 i = 0; i < count; i++) {
+        if (p[i] != q[i])
+            return p[i] - q[i];
+    }
+    return 0;
+}
+
+void memsetw(uint16* dest, uint16 value, uint32 count) {
+    asm volatile("rep stosw"
+                 : "+D"(dest), "+c"(count)
+                 : "a"(value)
+                 : "memory");
+}
@@ -0,0 +1,40 @@
+#ifndef MEM_H
+#define MEM_H
+// mem.h
+
+#include "kernel.h"
+
+// --- MEMORY PRIMITIVES ---
+// Bulk copies and fills use string instructions (rep movsd / rep stosd).
+// init_mem() enables the FPU and SSE if CPUID reports SSE2; copies and fills
+// of at least MEM_SSE_MIN bytes then move 16 bytes per instruction, except
+// in interrupt, fault and syscall context, where the guest's XMM registers
+// are live.
+#define MEM_SSE_MIN 256
+
+#define CPUID_EDX_FXSR 0x01000000
+#define CPUID_EDX_SSE  0x02000000
+#define CPUID_EDX_SSE2 0x04000000
+
+// Set once by init_mem(), 0 = string instructions only
+extern int mem_has_sse2;
+
+// Call once, early in kern_main. Everything below works before it, just
+// without SSE.
+void init_mem();
+
+// Enables SSE on the calling CPU if init_mem() found it. For APs.
+void init_mem_cpu();
+
+void* memcpy(void* dest, const void* src, uint32 count);
+void* memmove(void* dest, const void* src, uint32 count);
+void* memset(void* dest, int value, uint32 count);
+int memcmp(const void* a, const void* b, uint32 count);
+
+// Fills 'count' 16-bit words (VGA text cells)
+void memsetw(uint16* dest, uint16 value, uint32 count);
+
+static inline void cpuid(uint32 leaf, uint32* eax, uint32* ebx, uint32* ecx, uint32* edx) {
+    asm volatile("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(0));
+}
+#endif
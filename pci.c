@@ -0,0 +1,40 @@
+// pci.c
+// Configuration mechanism #1 (ports 0xCF8/0xCFC), which every PC chipset QEMU
+// emulates supports.
+#include "pci.h"
+#include "ports.h"
+
+uint32 pci_read32(uint32 addr, uint8 offset) {
+    outl(PCI_CONFIG_ADDRESS, 0x80000000 | addr | (offset & 0xFC));
+    return inl(PCI_CONFIG_DATA);
+}
+
+void pci_write32(uint32 addr, uint8 offset, uint32 value) {
+    outl(PCI_CONFIG_ADDRESS, 0x80000000 | addr | (offset & 0xFC));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+uint32 pci_find_class(uint8 class_code, uint8 subclass) {
+    // Chipset functions (IDE, LPC, ...) sit on the root bus; every config
+    // access is a VM exit, so the other 255 buses are not probed
+    for (uint32 dev = 0; dev < 32; dev++) {
+        for (uint32 fn = 0; fn < 8; fn++) {
+            uint32 addr = PCI_ADDR(0, dev, fn);
+            if ((pci_read32(addr, PCI_VENDOR_ID) & 0xFFFF) == 0xFFFF) {
+                // No function 0 means no device at all
+                if (fn == 0)
+                    break;
+                continue;
+            }
+
+            uint32 class_rev = pci_read32(addr, PCI_CLASS_REVISION);
+            if ((class_rev >> 24) == class_code && ((class_rev >> 16) & 0xFF) == subclass)
+                return addr;
+
+            // Bit 7 of the header type marks a multi-function device
+            if (fn == 0 && !((pci_read32(addr, PCI_HEADER_TYPE) >> 16) & 0x80))
+                break;
+        }
+    }
+    return PCI_NONE;
+}
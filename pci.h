@@ -0,0 +1,29 @@
+#ifndef PCI_H
+#define PCI_H
+// pci.h
+
+#include "kernel.h"
+
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA    0xCFC
+
+// Configuration space offsets
+#define PCI_VENDOR_ID      0x00
+#define PCI_COMMAND        0x04
+#define PCI_CLASS_REVISION 0x08 // class << 24 | subclass << 16 | prog_if << 8 | revision
+#define PCI_HEADER_TYPE    0x0E
+#define PCI_BAR4           0x20
+
+#define PCI_COMMAND_IO         0x0001
+#define PCI_COMMAND_BUS_MASTER 0x0004
+
+// Bus/device/function packed the way CONFIG_ADDRESS wants it
+#define PCI_ADDR(bus, dev, fn) (((bus) << 16) | ((dev) << 11) | ((fn) << 8))
+#define PCI_NONE 0xFFFFFFFF
+
+uint32 pci_read32(uint32 addr, uint8 offset);
+void pci_write32(uint32 addr, uint8 offset, uint32 value);
+
+// Returns the PCI_ADDR of the first bus 0 function with this class/subclass, or PCI_NONE
+uint32 pci_find_class(uint8 class_code, uint8 subclass);
+#endif
@@ -18,10 +18,30 @@ static inline void insw(uint16 port, void* addr, int count) {
     asm volatile("rep insw" : "+D"(addr), "+c"(count) : "d"(port) : "memory");
 }
 
+static inline void outsw(uint16 port, const void* addr, int count) {
+    asm volatile("rep outsw" : "+S"(addr), "+c"(count) : "d"(port) : "memory");
+}
+
 static inline void outw(uint16 port, uint16 val) {
     asm volatile ( "outw %0, %1" : : "a"(val), "Nd"(port) );
 }
 
+static inline uint16 inw(uint16 port) {
+    uint16 result;
+    asm volatile("inw %1, %0" : "=a"(result) : "Nd"(port));
+    return result;
+}
+
+static inline uint32 inl(uint16 port) {
+    uint32 result;
+    asm volatile("inl %1, %0" : "=a"(result) : "Nd"(port));
+    return result;
+}
+
+static inline void outl(uint16 port, uint32 val) {
+    asm volatile("outl %0, %1" : : "a"(val), "Nd"(port));
+}
+
 static inline void io_wait(void) {
     outb(0x80, 0); // Write to unused port to wait a few cycles
 }
@@ -0,0 +1,108 @@
+// serial.c
+#include "serial.h"
+#include "ports.h"
+
+#define SERIAL_LSR_THR_EMPTY 0x20 // FIFO mode: the whole transmit FIFO is empty
+#define SERIAL_LSR_IDLE      0x40 // Transmitter completely idle
+#define SERIAL_IER_THRE      0x02
+
+uint8 serial_tx_ring[SERIAL_TX_SIZE];
+volatile uint32 serial_tx_head = 0; // Next byte to queue
+volatile uint32 serial_tx_tail = 0; // Next byte to send
+int serial_ready = 0;               // Bytes queued before init_serial wait for it
+int serial_tx_irq = 0;              // THRE interrupt enabled (a refill is pending)
+
+void init_serial() {
+    outb(COM1_PORT + 1, 0x00); // Disable interrupts
+    outb(COM1_PORT + 3, 0x80); // Enable DLAB to set the baud rate divisor
+    outb(COM1_PORT + 0, 0x01); // Divisor 1 = 115200 baud (lo byte)
+    outb(COM1_PORT + 1, 0x00); //                          (hi byte)
+    outb(COM1_PORT + 3, 0x03); // 8 bits, no parity, one stop bit
+    outb(COM1_PORT + 2, 0xC7); // Enable FIFO, clear it, 14-byte threshold
+    outb(COM1_PORT + 4, 0x0B); // DTR | RTS | OUT2 (OUT2 gates IRQ4)
+
+    outb(0x21, inb(0x21) & ~(1 << 4)); // IRQ4 on the master PIC
+
+    uint32 flags = irq_save();
+    serial_ready = 1;
+    if (serial_tx_head != serial_tx_tail) {
+        serial_tx_irq = 1;
+        outb(COM1_PORT + 1, SERIAL_IER_THRE);
+    }
+    irq_restore(flags);
+}
+
+// Moves up to one FIFO worth of queued bytes into the UART. Caller has
+// interrupts off and has seen the FIFO empty.
+void serial_fill_fifo() {
+    for (int i = 0; i < SERIAL_FIFO_SIZE && serial_tx_tail != serial_tx_head; i++) {
+        outb(COM1_PORT, serial_tx_ring[serial_tx_tail & (SERIAL_TX_SIZE - 1)]);
+        serial_tx_tail++;
+    }
+}
+
+void serial_irq_handler() {
+    inb(COM1_PORT + 2); // Reading IIR acknowledges the THRE interrupt
+
+    if (inb(COM1_PORT + 5) & SERIAL_LSR_THR_EMPTY)
+        serial_fill_fifo();
+
+    // Nothing left: stop the interrupt until the next write
+    if (serial_tx_tail == serial_tx_head) {
+        serial_tx_irq = 0;
+        outb(COM1_PORT + 1, 0x00);
+    }
+}
+
+// Busy-waits for the FIFO to empty and refills it
+void serial_poll() {
+    while (!(inb(COM1_PORT + 5) & SERIAL_LSR_THR_EMPTY));
+    serial_fill_fifo();
+}
+
+void serial_write_byte(uint8 b) {
+    uint32 flags = irq_save();
+
+    if (serial_tx_head - serial_tx_tail == SERIAL_TX_SIZE) {
+        if (!serial_ready) {
+            irq_restore(flags);
+            return; // No UART yet: keep the oldest bytes, drop the rest
+        }
+        serial_poll();
+    }
+
+    serial_tx_ring[serial_tx_head & (SERIAL_TX_SIZE - 1)] = b;
+    serial_tx_head++;
+
+    // Idle transmitter: enabling the THRE interrupt fires it right away
+    if (serial_ready && !serial_tx_irq) {
+        serial_tx_irq = 1;
+        outb(COM1_PORT + 1, SERIAL_IER_THRE);
+    }
+    irq_restore(flags);
+}
+
+void serial_write(const void* data, uint32 length) {
+    const uint8* p = (const uint8*)data;
+
+    // One block: nothing written from an interrupt lands inside it
+    uint32 flags = irq_save();
+    for (uint32 i = 0; i < length; i++)
+        serial_write_byte(p[i]);
+    irq_restore(flags);
+}
+
+uint32 serial_space() {
+    return SERIAL_TX_SIZE - (serial_tx_head - serial_tx_tail);
+}
+
+void serial_flush() {
+    if (!serial_ready)
+        return;
+
+    uint32 flags = irq_save();
+    while (serial_tx_tail != serial_tx_head)
+        serial_poll();
+    while (!(inb(COM1_PORT + 5) & SERIAL_LSR_IDLE));
+    irq_restore(flags);
+}
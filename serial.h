@@ -0,0 +1,31 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include "kernel.h"
+
+#define COM1_PORT 0x3F8
+
+// Output is queued in a transmit ring and moved into the UART FIFO from the
+// COM1 interrupt (IRQ4), SERIAL_FIFO_SIZE bytes per interrupt. A full ring
+// is drained by polling, so writers never lose bytes.
+#define SERIAL_TX_SIZE   4096 // Must be a power of two
+#define SERIAL_FIFO_SIZE 16   // 16550 transmit FIFO
+
+void init_serial();
+void serial_write_byte(uint8 b);
+
+// Queues 'data' as one block: bytes from other writers (interrupts, the
+// timer's console flush) go before or after it, never into it. Waits with
+// interrupts off if the ring fills, so keep blocks short.
+void serial_write(const void* data, uint32 length);
+
+// Bytes serial_write can queue right now without waiting
+uint32 serial_space();
+
+// Waits until everything queued has left the UART. Works with interrupts off
+// (before halting or powering off).
+void serial_flush();
+
+// IRQ4: transmitter holding register empty
+void serial_irq_handler();
+#endif
@@ -0,0 +1,238 @@
+// smp.c
+#include "smp.h"
+#include "acpi.h"
+#include "timer.h"
+#include "hook.h"
+#include "mem.h"
+#include "print.h"
+#include "klog.h"
+
+// smp_trampoline.asm
+extern uint8 ap_trampoline[];
+extern uint8 ap_trampoline_end[];
+extern uint8 ap_param_stack[];
+extern uint8 ap_param_cr3[];
+extern uint8 ap_param_entry[];
+
+// interrupts.asm
+extern uint8 ap_fault_stubs[];
+extern void isr_spurious(void);
+extern void isr_smp_ipi_wrapper(void);
+extern void load_idt(void* base, unsigned short size);
+
+extern uint32 page_directory[1024];
+
+#define AP_FAULT_STUB_SIZE 16 // Must match ap_fault_stubs
+
+uint8 smp_stacks[SMP_MAX_CPUS - 1][SMP_STACK_SIZE] __attribute__((aligned(16)));
+struct IDTEntry ap_idt[256]; // The peripheral core's own IDT
+
+struct SMPQueue guest_queue; // Peripheral core -> guest core
+
+volatile int smp_peripheral_online = 0;
+volatile int smp_peripheral_idle = 0; // Halted, waiting for an IPI
+volatile int ap_started = 0;          // Set by the AP once it is in C
+uint32 boot_apic_id = 0;
+uint32 peripheral_apic_id = 0;
+
+// Sends an IPI and waits until the LAPIC has delivered it
+void lapic_send_ipi(uint32 apic_id, uint32 command) {
+    uint32 flags = irq_save();
+    lapic_write(LAPIC_ICR_HIGH, apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, command);
+    while (lapic_read(LAPIC_ICR_LOW) & ICR_PENDING)
+        asm volatile("pause");
+    irq_restore(flags);
+}
+
+// Busy-waits on the TSC calibrated by init_timer
+void delay_ticks(uint32 ticks) {
+    uint64 end = rdtsc() + (uint64)ticks * tsc_per_tick;
+    while (rdtsc() < end)
+        asm volatile("pause");
+}
+
+// Returns 0 if the queue is full
+int queue_push(struct SMPQueue* queue, SMPWorkFunction function, void* arg) {
+    uint32 head = queue->head;
+    if (head - queue->tail == SMP_QUEUE_SIZE)
+        return 0;
+
+    struct SMPWork* work = &queue->items[head & (SMP_QUEUE_SIZE - 1)];
+    work->function = function;
+    work->arg = arg;
+    asm volatile("" ::: "memory"); // Entry complete before the consumer sees it
+    queue->head = head + 1;
+    return 1;
+}
+
+// Runs everything queued, oldest first. Returns 1 if it ran anything.
+int queue_run(struct SMPQueue* queue) {
+    int ran = 0;
+    while (queue->tail != queue->head) {
+        struct SMPWork work = queue->items[queue->tail & (SMP_QUEUE_SIZE - 1)];
+        asm volatile("" ::: "memory"); // Copied before the slot is handed back
+        queue->tail++;
+        work.function(work.arg);
+        ran = 1;
+    }
+    return ran;
+}
+
+int smp_peripheral_work() {
+    if (smp_peripheral_online && smp_cpu_index() == 0)
+        return 0;
+
+    int ran = write_queue_pending();
+    drain_write_queue();
+    return ran;
+}
+
+void smp_run_guest_calls() {
+    queue_run(&guest_queue);
+}
+
+void smp_kick_peripheral() {
+    if (!smp_peripheral_online)
+        return;
+
+    // Pairs with the smp_mb() in peripheral_loop: either it sees the new
+    // work, or we see it idle
+    smp_mb();
+    if (smp_peripheral_idle)
+        lapic_send_ipi(peripheral_apic_id, ICR_FIXED | SMP_IPI_VECTOR);
+}
+
+void smp_call_guest(SMPWorkFunction function, void* arg) {
+    if (smp_cpu_index() == 0) {
+        function(arg);
+        return;
+    }
+
+    // The guest core empties the queue from the IPI, its next tick, or while
+    // it waits for room in one of our queues
+    while (!queue_push(&guest_queue, function, arg))
+        asm volatile("pause");
+    lapic_send_ipi(boot_apic_id, ICR_FIXED | SMP_IPI_VECTOR);
+}
+
+void smp_ipi_handler() {
+    // On the peripheral core the IPI only ends the hlt; its loop does the work
+    if (smp_cpu_index() == 0)
+        smp_run_guest_calls();
+}
+
+void peripheral_loop() {
+    while (1) {
+        asm volatile("cli");
+        if (smp_peripheral_work())
+            continue;
+
+        smp_peripheral_idle = 1;
+        smp_mb();
+        // Work published before 'idle' was visible is caught here; anything
+        // later comes with an IPI, which ends the hlt (sti delays it until then)
+        if (!write_queue_pending())
+            asm volatile("sti; hlt");
+        smp_peripheral_idle = 0;
+    }
+}
+
+// Any exception on the peripheral core (ap_fault_stubs). It is a bug in a
+// device model: page_fault_handler and the hook state belong to the guest
+// core, so nothing is retried here. Report it, drop the write whose handler
+// faulted (the guest core would only fault on it again), hand the queues
+// back to the guest core and stop this CPU.
+void ap_fault_handler(uint32 vector, struct TrapFrame* frame) {
+    uint32 cr2;
+    asm volatile("mov %%cr2, %0" : "=r"(cr2));
+    klog(KLOG_AP_FAULT, vector, frame->eip, cr2);
+    write_queue_drop_running();
+
+    smp_peripheral_idle = 0;
+    smp_peripheral_online = 0;
+    smp_mb();
+    while (1)
+        asm volatile("cli; hlt");
+}
+
+// AP entry from the trampoline: protected mode, paging on, own stack
+void ap_main() {
+    load_idt(ap_idt, sizeof(ap_idt) - 1);
+    init_mem_cpu();
+
+    // Each CPU has its own LAPIC behind the same address
+    lapic_write(LAPIC_SVR, 0x100 | TIMER_SPURIOUS);
+
+    ap_started = 1;
+    while (!smp_peripheral_online)
+        asm volatile("pause");
+    peripheral_loop();
+}
+
+// Address of a trampoline parameter once copied to SMP_TRAMPOLINE
+uint32* trampoline_param(uint8* label) {
+    return (uint32*)(SMP_TRAMPOLINE + (label - ap_trampoline));
+}
+
+void init_smp() {
+    // INIT-SIPI-SIPI goes through the LAPIC; the TSC times it
+    if (timer_backend == TIMER_BACKEND_PIT || acpi_cpu_count < 2) {
+        print("SMP: single CPU\n");
+        return;
+    }
+
+    boot_apic_id = lapic_read(LAPIC_ID) >> 24;
+
+    // The first other CPU becomes the peripheral core
+    int found = 0;
+    for (uint32 i = 0; i < acpi_cpu_count; i++) {
+        if (acpi_cpu_apic_ids[i] != boot_apic_id) {
+            peripheral_apic_id = acpi_cpu_apic_ids[i];
+            found = 1;
+            break;
+        }
+    }
+    if (!found) {
+        print("SMP: single CPU\n");
+        return;
+    }
+
+    // Its IDT: the wake-up IPI, plus every exception so a bad model access
+    // is reported instead of triple faulting
+    for (int i = 0; i < 32; i++)
+        set_idt_gate(ap_idt, i, (uint32)ap_fault_stubs + i * AP_FAULT_STUB_SIZE);
+    set_idt_gate(ap_idt, SMP_IPI_VECTOR, (uint32)isr_smp_ipi_wrapper);
+    set_idt_gate(ap_idt, TIMER_SPURIOUS, (uint32)isr_spurious);
+
+    memcpy((void*)SMP_TRAMPOLINE, ap_trampoline, ap_trampoline_end - ap_trampoline);
+    *trampoline_param(ap_param_stack) = (uint32)(smp_stacks[0] + SMP_STACK_SIZE);
+    *trampoline_param(ap_param_cr3) = (uint32)page_directory;
+    *trampoline_param(ap_param_entry) = (uint32)ap_main;
+
+    // INIT, 10ms, then up to two startup IPIs 200us apart (Intel MP spec)
+    lapic_send_ipi(peripheral_apic_id, ICR_INIT | ICR_LEVEL_ASSERT);
+    delay_ticks(10000 / TIMER_TICK_US);
+    for (int i = 0; i < 2 && !ap_started; i++) {
+        lapic_send_ipi(peripheral_apic_id, ICR_STARTUP | (SMP_TRAMPOLINE >> 12));
+        delay_ticks(200 / TIMER_TICK_US);
+    }
+
+    uint64 deadline = rdtsc() + (uint64)SMP_START_TIMEOUT * tsc_per_tick;
+    while (!ap_started && rdtsc() < deadline)
+        asm volatile("pause");
+    if (!ap_started) {
+        print("SMP: CPU did not start, single CPU\n");
+        return;
+    }
+
+    // Hand over the queues. Consumers on this CPU only run with interrupts
+    // off, so none is in the middle of a drain now.
+    uint32 flags = irq_save();
+    smp_peripheral_online = 1;
+    irq_restore(flags);
+
+    print("SMP: peripheral core on APIC ");
+    print_hex(peripheral_apic_id);
+    print("\n");
+}
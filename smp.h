@@ -0,0 +1,96 @@
+#ifndef SMP_H
+#define SMP_H
+// smp.h
+
+#include "kernel.h"
+
+// --- MULTIPROCESSOR SUPPORT ---
+// The boot CPU runs the guest, its faults, the virtual clock and the
+// console. init_smp() looks up the other CPUs in the ACPI MADT and starts
+// one of them (INIT-SIPI-SIPI) as the peripheral core: it runs the
+// deferred MMIO write handlers, so model work leaves the guest's CPU.
+// Further CPUs stay parked.
+//
+// The two cores talk over single-producer/single-consumer rings, published
+// by moving 'head' and retired by moving 'tail' (no locks, no atomics):
+//   guest core -> peripheral core: the deferred write queue (hook.h)
+//   peripheral core -> guest core: smp_call_guest()
+// A core that finds its rings empty halts; the producer sends it an IPI.
+//
+// Without a second CPU (or a LAPIC) everything stays on the boot CPU: the
+// timer interrupt and the idle loop do the peripheral core's work. The same
+// happens if the peripheral core takes an exception: it logs it (klog) and
+// halts for good.
+#define SMP_MAX_CPUS        2          // Boot CPU + peripheral core
+#define SMP_STACK_SIZE      16384      // Per AP, power of two
+#define SMP_QUEUE_SIZE      64         // Must be a power of two
+#define SMP_TRAMPOLINE      0x7000     // Real mode AP entry, page aligned, below 1MB
+#define SMP_IPI_VECTOR      0x31       // Wake-up IPI, next to TIMER_LAPIC_VECTOR
+#define SMP_START_TIMEOUT   2000       // Ticks (100ms) to wait for an AP to come up
+
+// LAPIC_ICR_LOW delivery modes and flags
+#define ICR_FIXED          0x000
+#define ICR_INIT           0x500
+#define ICR_STARTUP        0x600
+#define ICR_PENDING        0x1000  // Delivery status
+#define ICR_LEVEL_ASSERT   0x4000
+
+typedef void (*SMPWorkFunction)(void* arg);
+
+struct SMPWork {
+    SMPWorkFunction function;
+    void* arg;
+};
+
+struct SMPQueue {
+    struct SMPWork items[SMP_QUEUE_SIZE];
+    volatile uint32 head; // Next slot to fill (producer)
+    volatile uint32 tail; // Next slot to run (consumer)
+};
+
+extern volatile int smp_peripheral_online; // Peripheral core is running its loop
+extern uint8 smp_stacks[SMP_MAX_CPUS - 1][SMP_STACK_SIZE];
+
+// Orders earlier stores before later loads across CPUs (x86 only reorders
+// those). Used where a producer checks whether the consumer is asleep.
+static inline void smp_mb() {
+    asm volatile("lock; addl $0, (%%esp)" ::: "memory", "cc");
+}
+
+// 0 = boot CPU, 1.. = APs. Kernel code on an AP only ever runs on that
+// AP's stack (interrupts from ring 0 keep the stack), so the stack pointer
+// tells the CPUs apart without touching the LAPIC.
+static inline uint32 smp_cpu_index() {
+    uint32 esp;
+    asm volatile("mov %%esp, %0" : "=r"(esp));
+    uint32 offset = esp - (uint32)smp_stacks;
+    if (offset >= sizeof(smp_stacks))
+        return 0;
+    return 1 + offset / SMP_STACK_SIZE;
+}
+
+// After init_timer (needs the LAPIC and the calibrated TSC)
+void init_smp();
+
+// From the peripheral core: runs 'function' on the guest core, from an IPI
+// or its next timer tick. Models use it for anything that belongs to the
+// guest core (vclock events, set_mmio_register, printing). On the boot CPU
+// it runs 'function' right away. Waits while the queue is full; the guest
+// core also empties it while it waits on a full write queue, so the two
+// cores never wait on each other.
+void smp_call_guest(SMPWorkFunction function, void* arg);
+
+// Wakes the peripheral core if it is halted. Call after publishing work.
+void smp_kick_peripheral();
+
+// Peripheral core work: deferred writes. Does nothing on the
+// boot CPU while the peripheral core is online. Returns 1 if it ran anything.
+int smp_peripheral_work();
+
+// Guest core, interrupts off: runs what the peripheral core sent back. The
+// IPI handler runs it too, so with interrupts on it would have two consumers.
+void smp_run_guest_calls();
+
+// Wake-up IPI on either core (interrupts.asm)
+void smp_ipi_handler();
+#endif
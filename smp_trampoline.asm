@@ -0,0 +1,70 @@
+; smp_trampoline.asm
+; Application processor entry. init_smp copies the bytes between
+; ap_trampoline and ap_trampoline_end to SMP_TRAMPOLINE (0x7000) and fills
+; in the parameters; the startup IPI starts the AP there in real mode.
+; It loads its own flat GDT (which stays in that page), enables protected
+; mode and paging, and calls ap_main on the stack it was given.
+
+SMP_TRAMPOLINE equ 0x7000 ; Must match smp.h
+
+; Address of a trampoline label once copied to SMP_TRAMPOLINE
+%define TRAMPOLINE_ADDR(label) (SMP_TRAMPOLINE + (label - ap_trampoline))
+
+section .text
+
+global ap_trampoline
+global ap_trampoline_end
+global ap_param_stack
+global ap_param_cr3
+global ap_param_entry
+
+[bits 16]
+ap_trampoline:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    o32 lgdt [TRAMPOLINE_ADDR(ap_gdt_descriptor)]
+
+    mov eax, cr0
+    or eax, 1            ; PE
+    mov cr0, eax
+    jmp dword 0x08:TRAMPOLINE_ADDR(ap_protected_mode)
+
+[bits 32]
+ap_protected_mode:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+    mov esp, [TRAMPOLINE_ADDR(ap_param_stack)]
+
+    ; The boot CPU's page tables, with WP like init_paging
+    mov eax, [TRAMPOLINE_ADDR(ap_param_cr3)]
+    mov cr3, eax
+    mov eax, cr0
+    or eax, 0x80010000   ; PG | WP
+    mov cr0, eax
+
+    call dword [TRAMPOLINE_ADDR(ap_param_entry)]
+.halt:
+    cli
+    hlt
+    jmp .halt
+
+align 8
+ap_gdt:
+    dq 0                  ; Null
+    dq 0x00CF9A000000FFFF ; 0x08: code, flat 4GB (same selectors as the boot CPU)
+    dq 0x00CF92000000FFFF ; 0x10: data, flat 4GB
+ap_gdt_descriptor:
+    dw ap_gdt_descriptor - ap_gdt - 1
+    dd TRAMPOLINE_ADDR(ap_gdt)
+
+align 4
+ap_param_stack: dd 0      ; Top of the AP's stack
+ap_param_cr3:   dd 0      ; page_directory
+ap_param_entry: dd 0      ; ap_main
+ap_trampoline_end:
@@ -0,0 +1,6 @@
+#include "syscalls.h"
+
+void get_bcache_stats(struct BlockCacheStats* out, int reset) {
+    // EAX = Syscall Number, EBX = Buffer to fill (0 to skip), ECX = 1 to reset
+    syscall3(SYSCALL_BCACHE_STATS, (uint32)out, reset, 0);
+}
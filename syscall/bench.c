@@ -0,0 +1,6 @@
+#include "syscalls.h"
+
+void bench_result(char* name, uint32 cycles) {
+    // EAX = Syscall Number, EBX = Result name, ECX = Cycles
+    syscall3(SYSCALL_BENCH_RESULT, (uint32)name, cycles, 0);
+}
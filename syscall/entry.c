@@ -0,0 +1,13 @@
+#include "syscalls.h"
+
+// Initialized, so it lives in .data: the kernel does not clear an app's .bss
+int syscall_sysenter = -1;
+
+void syscall_probe() {
+    uint32 eax, ebx, ecx, edx;
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1), "c"(0));
+
+    // Early Pentium Pro (family 6, model < 3, stepping < 3) report SEP without having it
+    uint32 family = (eax >> 8) & 0xF, model = (eax >> 4) & 0xF, stepping = eax & 0xF;
+    syscall_sysenter = (edx & CPUID_EDX_SEP) && !(family == 6 && model < 3 && stepping < 3);
+}
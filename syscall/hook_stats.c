@@ -0,0 +1,8 @@
+#include "syscalls.h"
+
+int get_hook_stats(uint32 address, struct HookStats* out, int reset) {
+    // EAX = Syscall Number, EBX = Hooked address
+    // ECX = Buffer to fill (0 to skip), EDX = 1 to reset the counters
+    // Result comes back in EAX
+    return syscall3(SYSCALL_HOOK_STATS, address, (uint32)out, reset);
+}
@@ -2,23 +2,11 @@
 
 
 void print_hex(uint32 hex) {
-    asm volatile(
-            "movl %0, %%ebx \n"
-            "movl %1, %%eax \n"
-            "int $0x80      \n"
-            :
-            : "r"(hex), "i"(SYSCALL_PRINT_HEX)
-            : "eax", "ebx"
-            );
+    // EAX = Syscall Number, EBX = Value
+    syscall3(SYSCALL_PRINT_HEX, hex, 0, 0);
 }
 
 void print(char* data) {
-    asm volatile(
-            "movl %0, %%ebx \n"
-            "movl %1, %%eax \n"
-            "int $0x80      \n"
-            :
-            : "r"(data), "i"(SYSCALL_PRINT)
-            : "eax", "ebx"
-            );
-}
\ No newline at end of file
+    // EAX = Syscall Number, EBX = NUL terminated string
+    syscall3(SYSCALL_PRINT, (uint32)data, 0, 0);
+}
@@ -0,0 +1,71 @@
+#include "syscalls.h"
+
+#define ring ((struct IORing*)IORING_ADDR)
+
+// Producers may be the app and its timer callback (which runs inside the
+// kernel's timer interrupt), so a slot is claimed and published with
+// interrupts off. The app runs in ring 0 and may do that itself.
+static int ring_push(uint16 opcode, uint16 flags, uint32 user_data, uint32 arg0, uint32 arg1, uint32 arg2) {
+    uint32 eflags;
+    asm volatile("pushf; pop %0; cli" : "=r"(eflags) :: "memory");
+
+    uint32 tail = ring->sq_tail;
+    int queued = 0;
+    if (tail - ring->sq_head < IORING_SQ_ENTRIES) {
+        struct IORingRequest* req = &ring->sq[tail & (IORING_SQ_ENTRIES - 1)];
+        req->opcode = opcode;
+        req->flags = flags;
+        req->user_data = user_data;
+        req->args[0] = arg0;
+        req->args[1] = arg1;
+        req->args[2] = arg2;
+        // The entry is complete before the kernel can see it
+        asm volatile("" ::: "memory");
+        ring->sq_tail = tail + 1;
+        queued = 1;
+    }
+
+    asm volatile("push %0; popf" :: "r"(eflags) : "memory", "cc");
+    return queued;
+}
+
+int ring_submit(uint16 opcode, uint16 flags, uint32 user_data, uint32 arg0, uint32 arg1, uint32 arg2) {
+    if (ring_push(opcode, flags, user_data, arg0, arg1, arg2))
+        return 0;
+
+    ring_enter();
+    return ring_push(opcode, flags, user_data, arg0, arg1, arg2) ? 0 : -1;
+}
+
+uint32 ring_enter() {
+    // EAX = Syscall Number
+    return syscall3(SYSCALL_RING_ENTER, 0, 0, 0);
+}
+
+int ring_reap(struct IORingCompletion* out) {
+    uint32 head = ring->cq_head;
+    if (head == ring->cq_tail)
+        return 0;
+
+    *out = ring->cq[head & (IORING_CQ_ENTRIES - 1)];
+    // Copied out before the kernel may reuse the slot
+    asm volatile("" ::: "memory");
+    ring->cq_head = head + 1;
+    return 1;
+}
+
+void ring_print(char* data) {
+    ring_submit(IORING_OP_PRINT, IORING_SQE_SILENT, 0, (uint32)data, 0, 0);
+}
+
+void ring_print_hex(uint32 value) {
+    ring_submit(IORING_OP_PRINT_HEX, IORING_SQE_SILENT, 0, value, 0, 0);
+}
+
+void ring_log(const void* data, uint32 length) {
+    ring_submit(IORING_OP_LOG, IORING_SQE_SILENT, 0, (uint32)data, length, 0);
+}
+
+void ring_register_timer(void (*callback_func)()) {
+    ring_submit(IORING_OP_REGISTER_TIMER, IORING_SQE_SILENT, 0, (uint32)callback_func, 0, 0);
+}
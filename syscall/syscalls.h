@@ -4,12 +4,251 @@
 typedef unsigned char uint8;
 typedef unsigned short uint16;
 typedef unsigned int uint32;
+typedef unsigned long long uint64;
 
 #define SYSCALL_REGISTER_TIMER 1
 #define SYSCALL_PRINT_HEX 2
 #define SYSCALL_PRINT 3
+#define SYSCALL_HOOK_STATS 4
+#define SYSCALL_BENCH_RESULT 5
+#define SYSCALL_BCACHE_STATS 6
+#define SYSCALL_RING_ENTER 7
+
+// Per-hook latency histograms (log2 buckets of rdtsc cycles).
+// Must match struct HookStats in the kernel's hook.h
+#define HOOK_HIST_BUCKETS 32
+
+struct HookStats {
+    uint32 entry_to_callback[HOOK_HIST_BUCKETS];
+    uint32 callback[HOOK_HIST_BUCKETS];
+    uint32 callback_to_exit[HOOK_HIST_BUCKETS];
+};
+
+// Block cache counters. Must match struct BlockCacheStats in the kernel's bcache.h
+struct BlockCacheStats {
+    uint32 hits;
+    uint32 misses;
+    uint32 readahead;
+    uint32 readahead_hits;
+    uint32 evictions;
+};
+
+// --- SYSCALL ENTRY ---
+// EAX = syscall number, EBX/ECX/EDX = arguments, result in EAX; every other
+// register survives. Uses SYSENTER where the CPU has it (the kernel sets it
+// up whenever CPUID reports SEP), int 0x80 otherwise.
+#define CPUID_EDX_SEP 0x00000800
+#define SYSCALL_ERR_INVALID 0xFFFFFFFF // Unknown syscall number
+
+extern int syscall_sysenter; // 1 = SYSENTER, 0 = int 0x80, -1 = not probed yet
+void syscall_probe();
+
+static inline uint32 syscall3(uint32 number, uint32 arg1, uint32 arg2, uint32 arg3) {
+    uint32 result;
+
+    if (syscall_sysenter < 0)
+        syscall_probe();
+
+    if (syscall_sysenter) {
+        // The kernel returns with 'ret' on the stack in EBP: the call below
+        // leaves the address of the jmp on top of it. SYSENTER clears IF,
+        // popf brings it back.
+        asm volatile(
+                "pushf          \n"
+                "push %%ebp     \n"
+                "call 1f        \n"
+                "jmp 2f         \n"
+                "1:             \n"
+                "movl %%esp, %%ebp \n"
+                "sysenter       \n"
+                "2:             \n"
+                "pop %%ebp      \n"
+                "popf           \n"
+                : "=a"(result)
+                : "a"(number), "b"(arg1), "c"(arg2), "d"(arg3)
+                : "memory", "cc"
+                );
+    } else {
+        asm volatile(
+                "int $0x80      \n"
+                : "=a"(result)
+                : "a"(number), "b"(arg1), "c"(arg2), "d"(arg3)
+                : "memory"
+                );
+    }
+    return result;
+}
 
 void register_timer_function(void (*callback_func)());
 void print_hex(uint32);
 void print(char*);
+int get_hook_stats(uint32 address, struct HookStats* out, int reset);
+void bench_result(char* name, uint32 cycles);
+void get_bcache_stats(struct BlockCacheStats* out, int reset);
+
+// --- SHARED REQUEST RING ---
+// Requests queued here cost no trap. The kernel handles them when
+// ring_enter() rings the doorbell, or at the latest on its next timer
+// interrupt. Must match the kernel's ioring.h
+#define IORING_ADDR       0x1F3000
+#define IORING_SQ_ENTRIES 128
+#define IORING_CQ_ENTRIES 64
+
+#define IORING_OP_NOP            0
+#define IORING_OP_PRINT          1 // args[0] = string, must stay valid until handled
+#define IORING_OP_PRINT_HEX      2 // args[0] = value
+#define IORING_OP_LOG            3 // args[0] = bytes, args[1] = length: raw to COM1
+#define IORING_OP_REGISTER_TIMER 4 // args[0] = callback
+#define IORING_OP_DEVICE_READ    5 // args[0] = hooked address, args[1] = width
+#define IORING_OP_DEVICE_WRITE   6 // args[0] = hooked address, args[1] = width, args[2] = value
+
+#define IORING_SQE_SILENT 1 // No completion
+
+#define IORING_OK             0
+#define IORING_ERR_INVALID   -1
+#define IORING_ERR_NOT_FOUND -2
+
+struct IORingRequest {
+    uint16 opcode;
+    uint16 flags;
+    uint32 user_data;
+    uint32 args[3];
+};
+
+struct IORingCompletion {
+    uint32 user_data;
+    int status;
+    uint32 value;
+};
+
+struct IORing {
+    uint32 magic;
+    volatile uint32 sq_head;
+    volatile uint32 sq_tail;
+    volatile uint32 cq_head;
+    volatile uint32 cq_tail;
+    uint32 processed;
+    uint32 doorbells;
+    uint32 reserved[9];
+    struct IORingRequest sq[IORING_SQ_ENTRIES];
+    struct IORingCompletion cq[IORING_CQ_ENTRIES];
+};
+
+// Queues a request. If the ring is full, rings the doorbell once to make
+// room. Returns 0, or -1 if it stayed full (completions not reaped).
+int ring_submit(uint16 opcode, uint16 flags, uint32 user_data, uint32 arg0, uint32 arg1, uint32 arg2);
+
+// Doorbell: the kernel handles everything queued. Returns how many it handled
+uint32 ring_enter();
+
+// Takes the oldest completion. Returns 1, or 0 if there is none
+int ring_reap(struct IORingCompletion* out);
+
+// Fire-and-forget versions of the output syscalls
+void ring_print(char* data);
+void ring_print_hex(uint32 value);
+void ring_log(const void* data, uint32 length);
+void ring_register_timer(void (*callback_func)());
+
+// --- SHARED KERNEL DATA PAGE ---
+// Read-only page the kernel keeps current: the clock on every timer tick
+// and time jump, the hook counters on every trapped access. Reading it is a
+// memory load, not a syscall. Must match the kernel's vdso.h
+#define VDSO_ADDR  0x1F2000
+#define VDSO_HOOKS 64
+
+struct VDSOHookCounts {
+    uint32 address;
+    uint32 reads;
+    uint32 writes;
+    uint32 reserved;
+};
+
+struct VDSOData {
+    uint32 magic;
+    volatile uint32 seq;        // Odd while the kernel updates the page
+    uint32 tick_counter;        // Virtual time in 50us ticks
+    uint32 tick_us;
+    uint64 virtual_ticks;       // tick_counter without the 32-bit wrap
+    uint64 tsc;                 // rdtsc when virtual_ticks was last updated
+    uint32 tsc_per_tick;        // 0 until the kernel timer is calibrated
+    uint32 idle_ticks_skipped;
+    uint32 poll_fast_forwards;
+    uint32 hook_reads;          // Trapped reads, all hooks
+    uint32 hook_writes;         // Trapped writes, all hooks
+    uint32 reserved[3];
+    struct VDSOHookCounts hooks[VDSO_HOOKS];
+};
+
+#define vdso ((const volatile struct VDSOData*)VDSO_ADDR)
+
+// Seqlock read side: copy fields between vdso_read_begin() and
+// vdso_read_retry(), and start over while the latter returns 1.
+static inline uint32 vdso_read_begin() {
+    uint32 seq;
+    while ((seq = vdso->seq) & 1)
+        asm volatile("pause");
+    asm volatile("" ::: "memory");
+    return seq;
+}
+
+static inline int vdso_read_retry(uint32 seq) {
+    asm volatile("" ::: "memory");
+    return vdso->seq != seq;
+}
+
+// A single aligned load, consistent on its own
+static inline uint32 vdso_ticks() {
+    return vdso->tick_counter;
+}
+
+static inline uint64 vdso_virtual_ticks() {
+    uint32 seq;
+    uint64 ticks;
+    do {
+        seq = vdso_read_begin();
+        ticks = vdso->virtual_ticks;
+    } while (vdso_read_retry(seq));
+    return ticks;
+}
+
+// Virtual time in microseconds
+static inline uint64 vdso_time_us() {
+    uint32 seq;
+    uint64 ticks;
+    uint32 tick_us;
+    do {
+        seq = vdso_read_begin();
+        ticks = vdso->virtual_ticks;
+        tick_us = vdso->tick_us;
+    } while (vdso_read_retry(seq));
+    return ticks * tick_us;
+}
+
+// Trapped reads and writes of the hooked page at 'address' since it was
+// hooked. Returns 0 if the page is not among the published slots.
+static inline int vdso_hook_counts(uint32 address, uint32* reads, uint32* writes) {
+    uint32 seq;
+    int found;
+    address &= 0xFFFFF000;
+    do {
+        seq = vdso_read_begin();
+        found = 0;
+        for (int i = 0; i < VDSO_HOOKS; i++) {
+            if (vdso->hooks[i].address == address) {
+                *reads = vdso->hooks[i].reads;
+                *writes = vdso->hooks[i].writes;
+                found = 1;
+                break;
+            }
+        }
+    } while (vdso_read_retry(seq));
+    return found;
+}
+
+static inline uint64 rdtsc() {
+    uint32 lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64)hi << 32) | lo;
+}
 #endif
\ No newline at end of file
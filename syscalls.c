@@ -1,6 +1,11 @@
 #include "syscalls.h"
 #include "kernel.h"
 #include "print.h"
+#include "hook.h"
+#include "bench.h"
+#include "bcache.h"
+#include "mem.h"
+#include "ioring.h"
 
 void register_timer_interrupt_syscall(registers_t* regs) {
     register_timer_handler((void(*)(void))(regs->ebx));
@@ -14,8 +19,60 @@ void print_syscall(registers_t* regs) {
     print((char*) regs->ebx);
 }
 
-syscall_handler_function syscalls[] = {register_timer_interrupt_syscall, print_hex_syscall, print_syscall};
+// EBX = hooked address, ECX = struct HookStats* to fill (or 0), EDX = 1 to reset
+// Returns HOOK_OK or HOOK_ERR_NOT_FOUND in EAX
+void hook_stats_syscall(registers_t* regs) {
+    regs->eax = get_hook_stats(regs->ebx, (struct HookStats*) regs->ecx, regs->edx);
+}
+
+// EBX = result name, ECX = cycles
+void bench_result_syscall(registers_t* regs) {
+    bench_result((const char*) regs->ebx, regs->ecx);
+}
+
+// EBX = struct BlockCacheStats* to fill (or 0), ECX = 1 to reset
+void bcache_stats_syscall(registers_t* regs) {
+    get_bcache_stats((struct BlockCacheStats*) regs->ebx, regs->ecx);
+}
+
+// Doorbell: handles the requests queued in the shared ring (ioring.h)
+// Returns how many were handled in EAX
+void ring_enter_syscall(registers_t* regs) {
+    regs->eax = ioring_doorbell();
+}
 
+syscall_handler_function syscalls[] = {register_timer_interrupt_syscall, print_hex_syscall, print_syscall,
+                                       hook_stats_syscall, bench_result_syscall, bcache_stats_syscall,
+                                       ring_enter_syscall};
+
+#define SYSCALL_COUNT (sizeof(syscalls) / sizeof(syscalls[0]))
+
+// Shared by int 0x80 and SYSENTER
 void syscall_handler(registers_t *regs) {
+    // Unsigned: 0 wraps around and fails the check too
+    if (regs->eax - 1 >= SYSCALL_COUNT) {
+        regs->eax = SYSCALL_ERR_INVALID;
+        return;
+    }
     syscalls[regs->eax - 1](regs);
 }
+
+// SYSENTER lands on its own stack; syscalls do not nest (interrupts stay
+// off while they run), so one is enough
+uint8 sysenter_stack[SYSENTER_STACK_SIZE] __attribute__((aligned(16)));
+
+void init_sysenter() {
+    uint32 eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+
+    // Early Pentium Pro (family 6, model < 3, stepping < 3) report SEP without having it
+    uint32 family = (eax >> 8) & 0xF, model = (eax >> 4) & 0xF, stepping = eax & 0xF;
+    if (!(edx & CPUID_EDX_SEP) || (family == 6 && model < 3 && stepping < 3)) {
+        print("No SYSENTER, syscalls use int 0x80\n");
+        return;
+    }
+
+    wrmsr(MSR_SYSENTER_CS, 0x08); // Kernel code segment; SS becomes 0x10
+    wrmsr(MSR_SYSENTER_ESP, (uint32)(sysenter_stack + SYSENTER_STACK_SIZE));
+    wrmsr(MSR_SYSENTER_EIP, (uint32)sysenter_entry);
+}
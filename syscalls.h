@@ -12,4 +12,21 @@ typedef struct {
 typedef void(*syscall_handler_function)(registers_t*);
 void syscall_handler(registers_t *regs);
 
+#define SYSCALL_ERR_INVALID 0xFFFFFFFF // EAX for an unknown syscall number
+
+// --- SYSENTER FAST PATH ---
+// Same handlers and registers as int 0x80, minus the gate, the segment
+// reloads and iret. Guests pick it when CPUID reports SEP.
+#define MSR_SYSENTER_CS  0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+#define CPUID_EDX_SEP 0x00000800
+
+#define SYSENTER_STACK_SIZE 8192
+
+extern void sysenter_entry(void); // interrupts.asm
+
+void init_sysenter();
+
 #endif
\ No newline at end of file
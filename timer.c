@@ -0,0 +1,204 @@
+// timer.c
+#include "timer.h"
+#include "ports.h"
+#include "print.h"
+#include "mem.h"
+#include "vclock.h"
+#include "console.h"
+
+int timer_backend = TIMER_BACKEND_PIT;
+uint32 tsc_per_tick = 0;
+uint32 lapic_per_tick = 0;  // LAPIC timer counts per tick (divide by 1)
+uint64 timer_last_tsc = 0;  // TSC at the last whole tick accounted for
+uint64 timer_armed_tsc = 0; // TSC the next interrupt is due at, 0 = none pending
+
+// 64/32 division with a single divl (no libgcc here).
+// The caller makes sure the quotient fits in 32 bits.
+static inline uint32 div64_32(uint64 n, uint32 d) {
+    uint32 q, r;
+    asm("divl %4" : "=a"(q), "=d"(r) : "a"((uint32)n), "d"((uint32)(n >> 32)), "rm"(d));
+    return q;
+}
+
+// Boot tick: PIT at 50us (20kHz)
+// Base Frequency: 1193182 Hz
+// Divisor = 1193182 / 20000 = ~59
+void init_pit_50us() {
+    uint32 frequency = 1000000 / TIMER_TICK_US;
+    uint32 divisor = 1193180 / frequency;
+
+    // Command: Channel 0, Access lo/hi byte, Square Wave, 16-bit binary
+    outb(0x43, 0x36);
+
+    // Split divisor into bytes
+    uint8 l = (uint8)(divisor & 0xFF);
+    uint8 h = (uint8)( (divisor>>8) & 0xFF );
+
+    // Send Frequency
+    outb(0x40, l);
+    outb(0x40, h);
+}
+
+// PIT channel 2 counts down TIMER_CALIBRATE_MS while we watch the TSC and
+// the (free running, masked) LAPIC timer
+void timer_calibrate() {
+    uint32 count = 1193182 * TIMER_CALIBRATE_MS / 1000;
+    uint8 gate = inb(0x61) & ~0x03; // Speaker off, channel 2 gate low
+
+    outb(0x61, gate);
+    outb(0x43, 0xB0);               // Channel 2, lo/hi byte, mode 0 (one-shot), binary
+    outb(0x42, count & 0xFF);
+    outb(0x42, count >> 8);
+
+    lapic_write(LAPIC_TIMER_DIVIDE, 0xB); // Divide by 1
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_MASKED);
+    lapic_write(LAPIC_TIMER_INITIAL, 0xFFFFFFFF);
+
+    outb(0x61, gate | 1);           // Gate high: the countdown starts
+    uint64 tsc_start = rdtsc();
+    uint32 lapic_start = lapic_read(LAPIC_TIMER_CURRENT);
+
+    while (!(inb(0x61) & 0x20));    // OUT2 goes high at terminal count
+
+    uint64 tsc_end = rdtsc();
+    uint32 lapic_end = lapic_read(LAPIC_TIMER_CURRENT);
+    outb(0x61, gate);
+
+    uint32 ticks = TIMER_CALIBRATE_MS * 1000 / TIMER_TICK_US;
+    tsc_per_tick = (uint32)(tsc_end - tsc_start) / ticks;
+    lapic_per_tick = (lapic_start - lapic_end) / ticks;
+}
+
+// Programs the LAPIC to interrupt when the TSC reaches 'target'
+void timer_arm_at(uint64 target) {
+    timer_armed_tsc = target;
+
+    if (timer_backend == TIMER_BACKEND_TSC_DEADLINE) {
+        wrmsr(MSR_TSC_DEADLINE, target);
+        return;
+    }
+
+    // One-shot: convert the remaining TSC cycles to LAPIC counts, rounded
+    // up so the interrupt never comes before the tick boundary
+    uint64 now = rdtsc();
+    uint32 count = 1;
+    if (target > now) {
+        uint64 product = (target - now) * lapic_per_tick + tsc_per_tick - 1;
+        if ((uint32)(product >> 32) >= tsc_per_tick)
+            count = 0xFFFFFFFF;
+        else
+            count = div64_32(product, tsc_per_tick) + 1;
+    }
+    lapic_write(LAPIC_TIMER_INITIAL, count);
+}
+
+void init_timer() {
+    uint32 eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+
+    uint64 apic_base = rdmsr(MSR_APIC_BASE);
+    if (!(edx & CPUID_EDX_APIC) || (apic_base & 0xFFFFF000) != LAPIC_BASE) {
+        print("No local APIC, timer stays on the 20kHz PIT\n");
+        return;
+    }
+
+    // Map the LAPIC registers: Present | RW | Write-Through | Cache Disable
+    uint32* pte = get_pte(LAPIC_BASE);
+    if (!pte) {
+        print("ERR: Out of memory for the LAPIC mapping\n");
+        return;
+    }
+    *pte = LAPIC_BASE | 0x1B;
+    invlpg(LAPIC_BASE);
+
+    // Global enable, then software enable with the spurious vector.
+    // LINT0 keeps the BIOS virtual wire setup, so PIC interrupts still arrive.
+    wrmsr(MSR_APIC_BASE, apic_base | 0x800);
+    lapic_write(LAPIC_SVR, 0x100 | TIMER_SPURIOUS);
+
+    uint32 flags = irq_save();
+    timer_calibrate();
+    if (!tsc_per_tick || !lapic_per_tick) {
+        irq_restore(flags);
+        print("ERR: Timer calibration failed, staying on the PIT\n");
+        return;
+    }
+
+    if (ecx & CPUID_ECX_TSC_DEADLINE) {
+        timer_backend = TIMER_BACKEND_TSC_DEADLINE;
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_TSC_DEADLINE | TIMER_LAPIC_VECTOR);
+        // The MMIO write to the LVT and the WRMSR to IA32_TSC_DEADLINE are not
+        // ordered against each other; without the fence the deadline can be
+        // written while the LVT is still in its old mode and be lost (SDM 10.5.4.1)
+        asm volatile("mfence" ::: "memory");
+    } else {
+        timer_backend = TIMER_BACKEND_LAPIC;
+        lapic_write(LAPIC_LVT_TIMER, TIMER_LAPIC_VECTOR); // One-shot
+    }
+
+    // The PIT keeps counting, but IRQ0 is masked for good
+    outb(0x21, inb(0x21) | 0x01);
+
+    timer_last_tsc = rdtsc();
+    timer_arm(timer_next_work());
+    irq_restore(flags);
+
+    print(timer_backend == TIMER_BACKEND_TSC_DEADLINE ? "Timer: TSC deadline, " : "Timer: LAPIC one-shot, ");
+    print_hex(tsc_per_tick);
+    print(" TSC cycles per tick\n");
+}
+
+uint32 timer_elapsed_ticks() {
+    if (timer_backend == TIMER_BACKEND_PIT)
+        return 1;
+
+    timer_armed_tsc = 0;
+    uint64 now = rdtsc();
+    uint64 cycles = now - timer_last_tsc;
+
+    // Way behind (interrupts were off for seconds): resynchronise
+    if ((uint32)(cycles >> 32) >= tsc_per_tick) {
+        timer_last_tsc = now;
+        return TIMER_MAX_TICKS;
+    }
+
+    uint32 ticks = div64_32(cycles, tsc_per_tick);
+    timer_last_tsc += (uint64)ticks * tsc_per_tick;
+    return ticks;
+}
+
+void timer_arm(uint32 ticks) {
+    if (timer_backend == TIMER_BACKEND_PIT)
+        return;
+
+    if (ticks == 0)
+        ticks = 1;
+    if (ticks > TIMER_MAX_TICKS)
+        ticks = TIMER_MAX_TICKS;
+    timer_arm_at(timer_last_tsc + (uint64)ticks * tsc_per_tick);
+}
+
+void timer_kick(uint32 ticks) {
+    if (timer_backend == TIMER_BACKEND_PIT)
+        return;
+
+    uint32 flags = irq_save();
+    uint64 target = timer_last_tsc + (uint64)(ticks ? ticks : 1) * tsc_per_tick;
+    if (!timer_armed_tsc || target < timer_armed_tsc)
+        timer_arm_at(target);
+    irq_restore(flags);
+}
+
+uint32 timer_next_work() {
+    // The guest's callback runs on every tick
+    if (user_timer_callback)
+        return 1;
+
+    // Otherwise the next event, or the console refresh (which also drains
+    // deferred writes of a guest that never idles)
+    uint32 ticks = CONSOLE_FLUSH_TICKS;
+    uint32 event = next_event_delay();
+    if (event && event < ticks)
+        ticks = event;
+    return ticks;
+}
@@ -0,0 +1,76 @@
+#ifndef TIMER_H
+#define TIMER_H
+// timer.h
+
+#include "kernel.h"
+
+// --- TIMER BACKENDS ---
+// Boot starts on the PIT at a fixed 20kHz (one interrupt per 50us tick).
+// init_timer() calibrates the TSC and the local APIC timer against the PIT
+// once, then switches to the local APIC in one-shot mode, or TSC-deadline
+// mode where the CPU has it. From then on the timer only fires when
+// something is due: the per-tick guest callback, the next vclock event or
+// the console refresh. timer_handler() learns from the TSC how many ticks
+// actually passed.
+#define TIMER_BACKEND_PIT          0
+#define TIMER_BACKEND_LAPIC        1 // LAPIC one-shot, counts the APIC bus clock
+#define TIMER_BACKEND_TSC_DEADLINE 2 // LAPIC fires when the TSC reaches IA32_TSC_DEADLINE
+
+#define TIMER_TICK_US       50
+#define TIMER_LAPIC_VECTOR  0x30 // Above the slave PIC's 0x28-0x2F
+#define TIMER_SPURIOUS      0xFF
+#define TIMER_CALIBRATE_MS  10
+#define TIMER_MAX_TICKS     20000 // Never sleep longer than 1s
+
+#define LAPIC_BASE          0xFEE00000 // Mapped uncached by init_timer
+#define LAPIC_ID            0x20
+#define LAPIC_EOI           0xB0
+#define LAPIC_SVR           0xF0       // Spurious vector register
+#define LAPIC_LVT_TIMER     0x320
+#define LAPIC_TIMER_INITIAL 0x380
+#define LAPIC_TIMER_CURRENT 0x390
+#define LAPIC_TIMER_DIVIDE  0x3E0
+#define LAPIC_ICR_LOW       0x300      // Interrupt command: vector, delivery mode
+#define LAPIC_ICR_HIGH      0x310      // Interrupt command: destination APIC ID << 24
+
+#define LAPIC_TIMER_TSC_DEADLINE 0x40000 // LVT timer mode bits 17-18 = 10b
+#define LAPIC_MASKED             0x10000
+
+#define MSR_APIC_BASE    0x1B
+#define MSR_TSC_DEADLINE 0x6E0
+
+#define CPUID_EDX_APIC          0x00000200
+#define CPUID_ECX_TSC_DEADLINE  0x01000000
+
+static inline uint32 lapic_read(uint32 reg) {
+    return *(volatile uint32*)(LAPIC_BASE + reg);
+}
+
+static inline void lapic_write(uint32 reg, uint32 value) {
+    *(volatile uint32*)(LAPIC_BASE + reg) = value;
+}
+
+extern int timer_backend;      // TIMER_BACKEND_*
+extern uint32 tsc_per_tick;    // TSC cycles per 50us tick, 0 until calibrated
+
+// Programs the PIT for the 20kHz boot tick
+void init_pit_50us();
+
+// Calibrates and switches to the LAPIC backend if the CPU has a local
+// APIC. Needs paging on (maps the LAPIC). Stays on the PIT otherwise.
+void init_timer();
+
+// Called first thing in timer_handler: ticks passed since the previous
+// call (always 1 on the PIT)
+uint32 timer_elapsed_ticks();
+
+// Arms the next interrupt 'ticks' ticks after the last one accounted for
+void timer_arm(uint32 ticks);
+
+// Fires the timer within 'ticks' ticks if it is armed later than that
+// (a new event, a newly registered callback)
+void timer_kick(uint32 ticks);
+
+// Ticks until the timer next has work
+uint32 timer_next_work();
+#endif
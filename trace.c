@@ -0,0 +1,86 @@
+// trace.c
+#include "trace.h"
+#include "serial.h"
+#include "print.h"
+
+struct TraceRecord* trace_ring = 0;
+volatile uint32 trace_head = 0;   // Next record to fill (fault path)
+volatile uint32 trace_tail = 0;   // Next record to send (trace_flush)
+uint32 trace_dropped = 0;
+uint32 trace_flush_tick = 0;      // tick_counter at the last trace_tick flush
+int trace_enabled = 1;
+
+void init_trace() {
+    trace_ring = (struct TraceRecord*)alloc_pages(
+        (TRACE_RECORDS * sizeof(struct TraceRecord) + 4095) / 4096);
+    if (!trace_ring)
+        print("ERR: No memory for MMIO trace\n");
+}
+
+void trace_disable() {
+    uint32 flags = irq_save();
+    trace_enabled = 0;
+    trace_tail = trace_head;
+    trace_dropped = 0;
+    irq_restore(flags);
+}
+
+void trace_access(uint32 eip, uint32 address, uint32 value, int width, int is_write) {
+    if (!trace_ring || !trace_enabled)
+        return;
+
+    // Never block the guest: when the ring is full the record is dropped
+    if (trace_head - trace_tail == TRACE_RECORDS) {
+        trace_dropped++;
+        return;
+    }
+
+    struct TraceRecord* r = &trace_ring[trace_head & (TRACE_RECORDS - 1)];
+    r->tsc = rdtsc();
+    r->eip = eip;
+    r->address = address;
+    r->value = value;
+    r->width = width;
+    r->flags = is_write ? TRACE_WRITE : 0;
+    trace_head++;
+}
+
+void trace_flush() {
+    while (trace_head != trace_tail || trace_dropped) {
+        uint32 count = trace_head - trace_tail;
+        if (count > TRACE_BLOCK_RECORDS)
+            count = TRACE_BLOCK_RECORDS;
+
+        // Interrupts off: the block goes out whole, and the fault path
+        // cannot add a drop between reading and clearing the counter
+        uint32 flags = irq_save();
+        if (serial_space() < sizeof(struct TraceBlockHeader) + count * sizeof(struct TraceRecord)) {
+            // COM1 is behind; the rest goes out on a later flush
+            irq_restore(flags);
+            return;
+        }
+
+        struct TraceBlockHeader header;
+        header.magic = TRACE_MAGIC;
+        header.version = TRACE_VERSION;
+        header.record_size = sizeof(struct TraceRecord);
+        header.count = count;
+        header.dropped = trace_dropped;
+        trace_dropped = 0;
+        serial_write(&header, sizeof(header));
+
+        for (uint32 i = 0; i < count; i++) {
+            serial_write(&trace_ring[trace_tail & (TRACE_RECORDS - 1)], sizeof(struct TraceRecord));
+            trace_tail++;
+        }
+        irq_restore(flags);
+    }
+}
+
+void trace_tick() {
+    if (trace_head - trace_tail >= TRACE_FLUSH_PENDING ||
+        tick_counter - trace_flush_tick >= TRACE_FLUSH_TICKS) {
+        trace_flush_tick = tick_counter;
+        trace_flush();
+    }
+}
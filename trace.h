@@ -0,0 +1,58 @@
+#ifndef TRACE_H
+#define TRACE_H
+// trace.h
+
+#include "kernel.h"
+
+// --- MMIO ACCESS TRACE ---
+// Every hooked guest access is recorded into a ring and later streamed over
+// COM1 in a compact binary format (decode on the host with trace_decode.py).
+//
+// Stream layout, one block per trace_flush():
+//   TraceBlockHeader, then 'count' TraceRecords.
+// Blocks start with TRACE_MAGIC so the decoder can skip any other serial output.
+// Each block is queued on COM1 as a unit, and only once the transmit ring
+// has room for it, so other output never lands inside one.
+
+#define TRACE_MAGIC   0x4352544D // "MTRC"
+#define TRACE_VERSION 1
+#define TRACE_RECORDS 2048       // Ring size, must be a power of two
+#define TRACE_BLOCK_RECORDS 64   // Records per block, so a block fits the serial ring
+#define TRACE_FLUSH_PENDING 512  // trace_tick flushes once this many records wait...
+#define TRACE_FLUSH_TICKS   2000 // ...or this many ticks (100ms) after the last flush
+
+#define TRACE_WRITE    1         // TraceRecord.flags: access was a write
+
+struct TraceRecord {
+    uint64 tsc;       // rdtsc at the time of the access
+    uint32 eip;       // Guest instruction, HOOK_RING_EIP (0) for request ring accesses
+    uint32 address;   // Exact address accessed
+    uint32 value;     // Value read or written
+    uint8 width;      // Access width in bytes
+    uint8 flags;      // TRACE_*
+    uint16 reserved;
+} __attribute__((packed));
+
+struct TraceBlockHeader {
+    uint32 magic;
+    uint16 version;
+    uint16 record_size;
+    uint32 count;     // Records following this header
+    uint32 dropped;   // Records lost since the previous block (ring was full)
+} __attribute__((packed));
+
+void init_trace();
+
+// Stops recording and drops what has not been sent. Bench mode: COM1
+// carries the JSON results there, and tracing would skew the hook timings.
+void trace_disable();
+void trace_access(uint32 eip, uint32 address, uint32 value, int width, int is_write);
+
+// Streams pending records over COM1 (as much as the transmit ring takes).
+// Not from the fault path.
+void trace_flush();
+
+// Timer interrupt: flushes when the ring is filling up or at a low rate,
+// so a guest that never returns to the idle loop does not lose records
+void trace_tick();
+#endif
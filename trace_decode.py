@@ -0,0 +1,88 @@
+# trace_decode.py
+# Decodes the binary MMIO trace the kernel streams over COM1 (see trace.h).
+#
+# Usage: python3 trace_decode.py mmio_trace.bin
+#
+# Prints per-register access counts and the time between accesses to the
+# same register, hottest registers first.
+
+import struct
+import sys
+
+TRACE_MAGIC = b'MTRC'
+HEADER = struct.Struct('<4sHHII')        # magic, version, record_size, count, dropped
+RECORD = struct.Struct('<QIIIBBH')       # tsc, eip, address, value, width, flags, reserved
+TRACE_WRITE = 1
+
+def read_records(data):
+    records = []
+    dropped = 0
+    pos = 0
+
+    while True:
+        # Blocks are interleaved with any other serial output, resync on the magic
+        pos = data.find(TRACE_MAGIC, pos)
+        if pos < 0 or pos + HEADER.size > len(data):
+            break
+
+        magic, version, record_size, count, lost = HEADER.unpack_from(data, pos)
+        if version != 1 or record_size != RECORD.size:
+            pos += 1
+            continue
+
+        pos += HEADER.size
+        dropped += lost
+        for _ in range(count):
+            if pos + RECORD.size > len(data):
+                print(" ! Warning: trace ends in the middle of a block")
+                return records, dropped
+            records.append(RECORD.unpack_from(data, pos))
+            pos += RECORD.size
+
+    return records, dropped
+
+def report(records, dropped):
+    stats = {}
+    for tsc, eip, address, value, width, flags, _ in records:
+        s = stats.setdefault(address, {'reads': 0, 'writes': 0, 'last': None,
+                                       'gaps': [], 'eips': set()})
+        if flags & TRACE_WRITE:
+            s['writes'] += 1
+        else:
+            s['reads'] += 1
+        if s['last'] is not None:
+            s['gaps'].append(tsc - s['last'])
+        s['last'] = tsc
+        s['eips'].add(eip)
+
+    print(f"{len(records)} accesses, {len(stats)} registers, {dropped} dropped")
+    if records:
+        span = records[-1][0] - records[0][0]
+        print(f"Trace spans {span} cycles")
+    print()
+    print(f"{'address':>10} {'total':>8} {'reads':>8} {'writes':>8} {'eips':>5} "
+          f"{'min gap':>12} {'avg gap':>12} {'max gap':>12}")
+
+    hottest = sorted(stats.items(), key=lambda kv: kv[1]['reads'] + kv[1]['writes'], reverse=True)
+    for address, s in hottest:
+        gaps = s['gaps']
+        if gaps:
+            gap_cols = f"{min(gaps):>12} {sum(gaps) // len(gaps):>12} {max(gaps):>12}"
+        else:
+            gap_cols = f"{'-':>12} {'-':>12} {'-':>12}"
+        print(f"0x{address:08X} {s['reads'] + s['writes']:>8} {s['reads']:>8} {s['writes']:>8} "
+              f"{len(s['eips']):>5} {gap_cols}")
+
+def main():
+    if len(sys.argv) != 2:
+        print("Usage: python3 trace_decode.py <trace file>")
+        sys.exit(1)
+
+    with open(sys.argv[1], 'rb') as f:
+        data = f.read()
+
+    records, dropped = read_records(data)
+    report(records, dropped)
+
+if __name__ == "__main__":
+    main()
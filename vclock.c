@@ -0,0 +1,152 @@
+// vclock.c
+#include "vclock.h"
+#include "timer.h"
+#include "vdso.h"
+
+uint32 tick_counter = 0;
+
+struct TimerEvent* event_heap[MAX_EVENTS];
+int event_count = 0;
+uint32 idle_ticks_skipped = 0; // Ticks jumped over by vclock_idle
+
+// Deadline order that survives tick_counter wrapping
+static inline int before(uint32 a, uint32 b) {
+    return (int)(a - b) < 0;
+}
+
+void heap_set(int i, struct TimerEvent* event) {
+    event_heap[i] = event;
+    event->slot = i + 1;
+}
+
+void heap_up(int i) {
+    struct TimerEvent* event = event_heap[i];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!before(event->deadline, event_heap[parent]->deadline))
+            break;
+        heap_set(i, event_heap[parent]);
+        i = parent;
+    }
+    heap_set(i, event);
+}
+
+void heap_down(int i) {
+    struct TimerEvent* event = event_heap[i];
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= event_count)
+            break;
+        if (child + 1 < event_count && before(event_heap[child + 1]->deadline, event_heap[child]->deadline))
+            child++;
+        if (!before(event_heap[child]->deadline, event->deadline))
+            break;
+        heap_set(i, event_heap[child]);
+        i = child;
+    }
+    heap_set(i, event);
+}
+
+void heap_remove(struct TimerEvent* event) {
+    int i = event->slot - 1;
+    event->slot = 0;
+    event_count--;
+    if (i == event_count)
+        return;
+
+    // Fill the hole with the last entry and let it settle either way
+    struct TimerEvent* moved = event_heap[event_count];
+    heap_set(i, moved);
+    heap_down(i);
+    heap_up(moved->slot - 1);
+}
+
+int schedule_event(struct TimerEvent* event, uint32 delay) {
+    uint32 flags = irq_save();
+
+    if (event->slot)
+        heap_remove(event);
+    if (event_count == MAX_EVENTS) {
+        irq_restore(flags);
+        return EVENT_ERR_FULL;
+    }
+
+    event->deadline = tick_counter + delay;
+    event_count++;
+    heap_set(event_count - 1, event);
+    heap_up(event_count - 1);
+
+    // The one-shot timer may be armed past the new deadline
+    timer_kick(delay);
+
+    irq_restore(flags);
+    return EVENT_OK;
+}
+
+void cancel_event(struct TimerEvent* event) {
+    uint32 flags = irq_save();
+    if (event->slot)
+        heap_remove(event);
+    irq_restore(flags);
+}
+
+uint32 next_event_delay() {
+    if (!event_count)
+        return 0;
+    uint32 deadline = event_heap[0]->deadline;
+    return before(tick_counter, deadline) ? deadline - tick_counter : 1;
+}
+
+uint32 event_delay(struct TimerEvent* event) {
+    if (!event->slot)
+        return 0;
+    return before(tick_counter, event->deadline) ? event->deadline - tick_counter : 1;
+}
+
+void run_due_events() {
+    while (event_count && !before(tick_counter, event_heap[0]->deadline)) {
+        struct TimerEvent* event = event_heap[0];
+
+        // Re-arm before the callback, so it can cancel or move the event
+        heap_remove(event);
+        if (event->period) {
+            event->deadline += event->period;
+            event_count++;
+            heap_set(event_count - 1, event);
+            heap_up(event_count - 1);
+        }
+        event->callback(event);
+    }
+}
+
+// Jumps time forward without running the per-tick callbacks. Events due
+// on the way fire in order, each with tick_counter at its own deadline.
+// Used when the guest is provably just waiting for a device.
+void advance_ticks(uint32 ticks) {
+    uint32 flags = irq_save();
+    uint32 target = tick_counter + ticks;
+
+    while (event_count && !before(target, event_heap[0]->deadline)) {
+        if (before(tick_counter, event_heap[0]->deadline))
+            tick_counter = event_heap[0]->deadline;
+        run_due_events();
+    }
+    tick_counter = target;
+    vdso_update_clock();
+
+    irq_restore(flags);
+}
+
+int vclock_idle() {
+    if (!VCLOCK_IDLE_FAST_FORWARD || !event_count)
+        return 0;
+
+    uint32 deadline = event_heap[0]->deadline;
+    if (before(tick_counter, deadline)) {
+        idle_ticks_skipped += deadline - tick_counter;
+        advance_ticks(deadline - tick_counter);
+    } else {
+        run_due_events();
+    }
+    return 1;
+}
@@ -0,0 +1,52 @@
+#ifndef VCLOCK_H
+#define VCLOCK_H
+// vclock.h
+
+#include "kernel.h"
+
+// --- VIRTUAL CLOCK ---
+// Emulated time is tick_counter (50us ticks). The PIT moves it forward one
+// tick per interrupt; advance_ticks() jumps it forward when the guest is
+// provably waiting. Peripheral models schedule events on it (a timer
+// overflow, SysTick, a UART byte finishing) instead of counting ticks in a
+// per-tick callback. Events fire in deadline order, also across jumps.
+//
+// Pending events sit in a binary min-heap ordered by deadline, so the next
+// one is always at the top.
+#define MAX_EVENTS 64
+
+#define VCLOCK_IDLE_FAST_FORWARD 1 // Idle loop jumps straight to the next event
+
+// schedule_event results
+#define EVENT_OK        0
+#define EVENT_ERR_FULL -1 // MAX_EVENTS already pending
+
+struct TimerEvent;
+typedef void (*EventCallback)(struct TimerEvent* event);
+
+struct TimerEvent {
+    EventCallback callback; // Runs with interrupts off, at tick_counter == deadline
+    void* data;             // For the model
+    uint32 period;          // 0 = one-shot, else re-armed every 'period' ticks
+    uint32 deadline;        // tick_counter value it fires at
+    uint32 slot;            // Heap position + 1, 0 = not scheduled
+};
+
+// Fires 'event' 'delay' ticks from now (0 = on the next check). An event
+// that is already pending is moved.
+int schedule_event(struct TimerEvent* event, uint32 delay);
+void cancel_event(struct TimerEvent* event);
+
+// Ticks until the next event (at least 1), or 0 if nothing is scheduled
+uint32 next_event_delay();
+
+// Ticks until 'event' fires (at least 1), or 0 if it is not scheduled
+uint32 event_delay(struct TimerEvent* event);
+
+// Fires every event that is due. Called on every timer tick.
+void run_due_events();
+
+// Idle loop, interrupts off: if an event is pending, jumps time to it and
+// fires it. Returns 0 if there was nothing to do (the caller halts).
+int vclock_idle();
+#endif
@@ -0,0 +1,96 @@
+// vdso.c
+#include "vdso.h"
+#include "hook.h"
+#include "timer.h"
+#include "print.h"
+#include "mem.h"
+
+extern struct HookEntry hooks[];
+extern uint32 idle_ticks_skipped; // vclock.c
+extern uint32 poll_fast_forwards; // kernel.c
+
+struct VDSOData* vdso = 0; // Kernel's writable view (heap frame)
+uint32 vdso_last_tick = 0;
+
+static inline void vdso_write_begin() {
+    vdso->seq++;
+    asm volatile("" ::: "memory");
+}
+
+static inline void vdso_write_end() {
+    asm volatile("" ::: "memory");
+    vdso->seq++;
+}
+
+void init_vdso() {
+    struct VDSOData* page = (struct VDSOData*)alloc_page();
+    uint32* pte = page ? get_pte(VDSO_ADDR) : 0;
+    if (!pte) {
+        print("ERR: Out of memory for vDSO page\n");
+        return;
+    }
+
+    page->magic = VDSO_MAGIC;
+    page->tick_us = TIMER_TICK_US;
+    page->tick_counter = tick_counter;
+    page->virtual_ticks = tick_counter;
+    vdso_last_tick = tick_counter;
+    vdso = page;
+
+    // Present, not writable
+    *pte = (uint32)page | 1;
+    invlpg(VDSO_ADDR);
+}
+
+void vdso_update_clock() {
+    if (!vdso)
+        return;
+
+    uint32 flags = irq_save();
+    vdso_write_begin();
+    vdso->virtual_ticks += tick_counter - vdso_last_tick;
+    vdso_last_tick = tick_counter;
+    vdso->tick_counter = tick_counter;
+    vdso->tsc = rdtsc();
+    vdso->tsc_per_tick = tsc_per_tick;
+    vdso->idle_ticks_skipped = idle_ticks_skipped;
+    vdso->poll_fast_forwards = poll_fast_forwards;
+    vdso_write_end();
+    irq_restore(flags);
+}
+
+void vdso_hook_slot(struct HookEntry* hook, uint32 address) {
+    uint32 slot = hook - hooks;
+    if (!vdso || slot >= VDSO_HOOKS)
+        return;
+
+    uint32 flags = irq_save();
+    vdso_write_begin();
+    vdso->hooks[slot].address = address;
+    vdso->hooks[slot].reads = 0;
+    vdso->hooks[slot].writes = 0;
+    vdso_write_end();
+    irq_restore(flags);
+}
+
+void vdso_hook_access(struct HookEntry* hook, int is_write) {
+    if (!vdso)
+        return;
+
+    uint32 slot = hook - hooks;
+    uint32 flags = irq_save();
+    vdso_write_begin();
+    if (is_write) {
+        vdso->hook_writes++;
+        if (slot < VDSO_HOOKS)
+            vdso->hooks[slot].writes++;
+    } else {
+        vdso->hook_reads++;
+        if (slot < VDSO_HOOKS)
+            vdso->hooks[slot].reads++;
+    }
+    // Polling detection may have jumped time forward
+    vdso->poll_fast_forwards = poll_fast_forwards;
+    vdso_write_end();
+    irq_restore(flags);
+}
@@ -0,0 +1,59 @@
+#ifndef VDSO_H
+#define VDSO_H
+// vdso.h
+
+#include "kernel.h"
+
+struct HookEntry;
+
+// --- SHARED KERNEL DATA PAGE ---
+// Clock and hook counters the guest can read with plain loads instead of a
+// syscall. The kernel writes the page through its heap frame; the app sees
+// the same frame mapped read-only at VDSO_ADDR (CR0.WP makes that hold in
+// ring 0).
+//
+// Consistency is a seqlock: the kernel makes 'seq' odd, updates, and makes
+// it even again. A reader samples 'seq', copies what it needs and retries
+// if 'seq' was odd or has moved. Updates run with interrupts off, so they
+// never interleave and a reader on the same CPU never waits on one.
+// The guest layout is repeated in syscall/syscalls.h; keep both in sync.
+#define VDSO_ADDR  0x1F2000   // Between the bench device and the request ring
+#define VDSO_MAGIC 0x4F534456 // "VDSO"
+#define VDSO_HOOKS 64         // Hook slots published (hooks[0..63])
+
+struct VDSOHookCounts {
+    uint32 address;  // Hooked page, 0 = slot unused
+    uint32 reads;    // Trapped guest reads since registration
+    uint32 writes;   // Trapped guest writes since registration
+    uint32 reserved;
+};
+
+struct VDSOData {
+    uint32 magic;
+    volatile uint32 seq;        // Odd while the kernel updates the page
+    uint32 tick_counter;        // Virtual time in TIMER_TICK_US ticks
+    uint32 tick_us;             // Length of a tick in microseconds
+    uint64 virtual_ticks;       // tick_counter without the 32-bit wrap
+    uint64 tsc;                 // rdtsc when virtual_ticks was last updated
+    uint32 tsc_per_tick;        // 0 until the timer is calibrated
+    uint32 idle_ticks_skipped;  // Ticks jumped over by the idle loop
+    uint32 poll_fast_forwards;  // Spin-waits skipped by polling detection
+    uint32 hook_reads;          // Trapped reads, all hooks
+    uint32 hook_writes;         // Trapped writes, all hooks
+    uint32 reserved[3];
+    struct VDSOHookCounts hooks[VDSO_HOOKS];
+};
+
+// Allocates the page and maps it at VDSO_ADDR. After init_paging, before
+// hooks are registered. Updates before it are dropped.
+void init_vdso();
+
+// advance_ticks: publishes the clock
+void vdso_update_clock();
+
+// register_hook / unregister_hook: (re)starts the slot's counters
+void vdso_hook_slot(struct HookEntry* hook, uint32 address);
+
+// Page fault handler: one trapped access
+void vdso_hook_access(struct HookEntry* hook, int is_write);
+#endif
@@ -0,0 +1,74 @@
+// vtimer.c
+#include "vtimer.h"
+#include "hook.h"
+#include "vclock.h"
+#include "print.h"
+
+enum { REG_CTRL, REG_LOAD, REG_STATUS, REG_COUNT };
+
+struct TimerEvent vtimer_event;
+
+void vtimer_ctrl_write(struct MMIORegister* reg, uint32 address, uint32 value, int width);
+void vtimer_status_write(struct MMIORegister* reg, uint32 address, uint32 value, int width);
+uint32 vtimer_count_read(struct MMIORegister* reg, uint32 address, int width);
+uint32 vtimer_status_poll(struct MMIORegister* reg, uint32 address);
+
+struct MMIORegister vtimer_registers[] = {
+    // offset,        width, read,              write,               reset, value, poll
+    {  VTIMER_CTRL,   4,     0,                 vtimer_ctrl_write,   0,     0,     0 },
+    {  VTIMER_LOAD,   4,     0,                 0,                   0,     0,     0 },
+    {  VTIMER_STATUS, 4,     0,                 vtimer_status_write, 0,     0,     vtimer_status_poll },
+    {  VTIMER_COUNT,  4,     vtimer_count_read, 0,                   0,     0,     0 },
+};
+
+// Deadline reached (run_due_events, guest core)
+void vtimer_expired(struct TimerEvent* event) {
+    set_mmio_register(VTIMER_DEVICE_ADDR + VTIMER_STATUS,
+                      vtimer_registers[REG_STATUS].value | VTIMER_STATUS_EXPIRED);
+    if (!event->period)
+        set_mmio_register(VTIMER_DEVICE_ADDR + VTIMER_CTRL,
+                          vtimer_registers[REG_CTRL].value & ~VTIMER_CTRL_ENABLE);
+}
+
+void vtimer_ctrl_write(struct MMIORegister* reg, uint32 address, uint32 value, int width) {
+    uint32 load = vtimer_registers[REG_LOAD].value;
+    reg->value = value & (VTIMER_CTRL_ENABLE | VTIMER_CTRL_PERIODIC);
+
+    if (!(reg->value & VTIMER_CTRL_ENABLE) || !load) {
+        reg->value &= ~VTIMER_CTRL_ENABLE;
+        cancel_event(&vtimer_event);
+        return;
+    }
+
+    vtimer_event.period = (reg->value & VTIMER_CTRL_PERIODIC) ? load : 0;
+    if (schedule_event(&vtimer_event, load) != EVENT_OK)
+        reg->value &= ~VTIMER_CTRL_ENABLE;
+}
+
+void vtimer_status_write(struct MMIORegister* reg, uint32 address, uint32 value, int width) {
+    reg->value &= ~value;
+}
+
+uint32 vtimer_count_read(struct MMIORegister* reg, uint32 address, int width) {
+    return event_delay(&vtimer_event);
+}
+
+// Spinning on STATUS: the bit flips when the event fires
+uint32 vtimer_status_poll(struct MMIORegister* reg, uint32 address) {
+    if (reg->value & VTIMER_STATUS_EXPIRED)
+        return 0;
+    return event_delay(&vtimer_event);
+}
+
+void vtimer_reset() {
+    cancel_event(&vtimer_event);
+    for (int i = 0; i < sizeof(vtimer_registers) / sizeof(vtimer_registers[0]); i++)
+        set_mmio_register(VTIMER_DEVICE_ADDR + vtimer_registers[i].offset, vtimer_registers[i].reset_value);
+}
+
+void init_vtimer() {
+    vtimer_event.callback = vtimer_expired;
+    if (register_mmio_hook(VTIMER_DEVICE_ADDR, vtimer_registers,
+                           sizeof(vtimer_registers) / sizeof(vtimer_registers[0])) != HOOK_OK)
+        print("ERR: Timer device registration failed\n");
+}
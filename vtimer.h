@@ -0,0 +1,33 @@
+#ifndef VTIMER_H
+#define VTIMER_H
+// vtimer.h
+
+#include "kernel.h"
+
+// --- COUNTDOWN TIMER DEVICE ---
+// A hooked page with a SysTick-like down counter that runs on virtual time.
+// Starting it schedules a vclock event for the expiry instead of counting
+// in a per-tick callback, and STATUS has a poll handler, so a guest that
+// spins on the expired bit is moved straight to the deadline.
+//
+//   0x00 CTRL   bit 0 enable, bit 1 periodic (reload from LOAD and go on)
+//   0x04 LOAD   period in ticks (TIMER_TICK_US each); taken when enabled
+//   0x08 STATUS bit 0 expired, write 1 to clear
+//   0x0C COUNT  ticks left until the next expiry (read-only)
+#define VTIMER_DEVICE_ADDR 0x1F4000 // Above the request ring
+
+#define VTIMER_CTRL   0x00
+#define VTIMER_LOAD   0x04
+#define VTIMER_STATUS 0x08
+#define VTIMER_COUNT  0x0C
+
+#define VTIMER_CTRL_ENABLE     0x1
+#define VTIMER_CTRL_PERIODIC   0x2
+#define VTIMER_STATUS_EXPIRED  0x1
+
+// Hooks the device page. After init_paging.
+void init_vtimer();
+
+// Stops the counter and clears the registers (run_app, before the next app)
+void vtimer_reset();
+#endif